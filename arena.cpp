@@ -0,0 +1,46 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstdlib>
+
+arena mem;
+
+// Size of each block we ask malloc for.
+// Larger objects get a block of their own.
+const size_t block_size = 1 << 20;
+
+void* arena::alloc(size_t sz, size_t align) {
+    size_t pad = -(size_t) curr & (align - 1);
+    if (pad + sz > left) {
+        size_t bsz = std::max(sz + alignof(std::max_align_t), block_size);
+        char* b = (char*) malloc(bsz);
+        if (!b)
+            throw std::bad_alloc();
+        *(char**) b = blocks;
+        blocks = b;
+
+        curr = b + alignof(std::max_align_t);
+        left = bsz - alignof(std::max_align_t);
+        pad = 0;
+    }
+
+    void* p = curr + pad;
+    curr += pad + sz;
+    left -= pad + sz;
+    total += sz;
+    return p;
+}
+
+void arena::release() {
+    // Newest objects are destroyed first
+    for (dtor* d = dtors; d; d = d->next)
+        d->fn(d->obj);
+    dtors = nullptr;
+
+    while (blocks) {
+        char* next = *(char**) blocks;
+        free(blocks);
+        blocks = next;
+    }
+    curr = nullptr;
+    left = 0;
+}
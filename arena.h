@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// A bump allocator owning every object of one translation unit.
+// Nothing is freed individually; release() destroys everything at once.
+//
+// It has no members needing construction, so a global arena is usable
+// even from static initialisers of other translation units.
+class arena {
+    // Blocks are chained through their first word
+    char* blocks = nullptr;
+    char* curr = nullptr;
+    size_t left = 0;
+    size_t total = 0;
+
+    // Objects that need their destructors run on release(),
+    // newest first. The records themselves live in the arena.
+    struct dtor {
+        void (*fn)(void*);
+        void* obj;
+        dtor* next;
+    };
+    dtor* dtors = nullptr;
+
+    void* alloc(size_t sz, size_t align);
+public:
+    template<class T, class... Args>
+    T* make(Args&&... args) {
+        T* p = new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            auto fn = [](void* x) { ((T*) x)->~T(); };
+            dtors = new (alloc(sizeof(dtor), alignof(dtor))) dtor { fn, p, dtors };
+        }
+        return p;
+    }
+
+    // Bytes handed out so far.
+    size_t used() { return total; }
+
+    void release();
+
+    ~arena() { release(); }
+};
+
+// Arena of the frontend: AST nodes, types, variables and functions.
+extern arena mem;
+
+template<class T, class... Args>
+T* make(Args&&... args) {
+    return mem.make<T>(std::forward<Args>(args)...);
+}
@@ -1,19 +1,16 @@
 #define FMT_HEADER_ONLY
 
 #include "assem.h"
+#include "regalloc.h"
 #include "fmt/format.h" // workaround of C++20
 #include <iostream>
 #include <algorithm>
+#include <climits>
+#include <unordered_set>
 #define MAPPED std::make_pair
 
 using fmt::format;
 
-// Other registers are unused because they are of different uses (eg. function arguments)
-// Perhaps fix this later.
-const char* regs[] = { "r10", "r11", "r12", "r13", "r14", "r15", "rbx", "rdi" };
-const int rsz = sizeof(regs) / sizeof(const char*);
-reg* used[rsz] = { 0 };
-
 std::map<ir_type, std::string> cmpmap {
     MAPPED(I_LE, "setl"),
     MAPPED(I_GE, "setg"),
@@ -23,99 +20,41 @@ std::map<ir_type, std::string> cmpmap {
     MAPPED(I_NEQ, "setne"),
 };
 
+// Jumps taken if the comparison holds, and if it doesn't
+std::map<ir_type, std::pair<std::string, std::string>> jmpmap {
+    MAPPED(I_LE, MAPPED("jl", "jge")),
+    MAPPED(I_GE, MAPPED("jg", "jle")),
+    MAPPED(I_LEQ, MAPPED("jle", "jg")),
+    MAPPED(I_GEQ, MAPPED("jge", "jl")),
+    MAPPED(I_EQ, MAPPED("je", "jne")),
+    MAPPED(I_NEQ, MAPPED("jne", "je")),
+};
+
 // Round val up to the smallest integer that is divisible by x
 // and larger than val.
 int round_up(int val, int x) {
     return ceil(1.0 * val / x) * x;
 }
 
-bool assign(func* f, reg* a) {
-    if (!a)
-        return true;
-
-    bool found = false;
-    
-    // We preserve the final register as a destination of spilling
-    // All spilt registers store their values there
-    for (int i = 0; i < rsz - 2; i++) {
-        if (used[i] && used[i]->last > a->first)
-            continue;
-        used[i] = a;
-        a->real = i;
-        found = true;
-        break;
-    }
-    
-    return found;
-}
-
-// Returns how many registers we need to push & pop
-int tidy_register(func* f, std::vector<ir*>& irs) {
-    std::vector<reg*> rs;
-    // instruction counter
-    // starts at 1, so that !first will not fail
-    int ic = 1;
-
-    memset(used, 0, sizeof used);
-
-    for (int i = 0; i < irs.size(); i++, ic++) {
-        auto x = irs[i];
-
-        // a1 never gets newly defined
-        if (x->a0 && !x->a0->first) {
-            rs.push_back(x->a0);
-            x->a0->first = ic;
-        }
-        
-        if (x->a0)
-            x->a0->last = std::max(x->a0->last, ic);
-        if (x->a1)
-            x->a1->last = std::max(x->a1->last, ic);
-        if (x->params.size())
-            for (auto r : x->params)
-                r->last = std::max(r->last, ic);
-    }
-
-    std::sort(rs.begin(), rs.end(), [](reg* a, reg* b) {
-        return a->first < b->first;
-    });
-    for (auto r : rs) {
-        if (assign(f, r))
-            continue;
-        
-        var* v = new var;
-        v->ty = type::ptr(new type(K_INT));
-        f->v->push(v);
-
-        r->spilt = true;
-        r->dest = v;
-        r->real = 0;
-    }
-
-    int max = 0;
-    for (auto r : rs)
-        max = std::max(max, r->real);
-    return std::max(0, max - 1);
-}
-
-void assemble_var(std::ostream& os) {
+// used holds the string literals the code refers to; the rest are left out.
+void assemble_var(std::ostream& os, const std::unordered_set<var*>& used) {
     // All explicitly initialised variables should go into data segment
     os << "section .data\n";
-    for (auto x : global->vars)
-        if (x->is_strlit) {
-            os << format("{}: db ", x->name);
+    for (auto x : globals)
+        if (x->is_strlit && used.count(x)) {
+            os << format("{}: db ", name_of(x->name));
             // To avoid things like, say, \n in strings
             // getting printed out as a new line rather than as "\\n"
-            for (auto x : x->value)
+            for (auto x : name_of(x->value))
                 os << format("{}, ", (int) x);
             os << "0\n";
         }
     
     // The rest of everything is in .bss, which is zero-initialised  
     os << "section .bss\n";
-    for (auto x : global->vars)
+    for (auto x : globals)
         if (!x->is_strlit)
-            os << format("{} resb {}\n", x->name, x->ty->sz);
+            os << format("{} resb {}\n", name_of(x->name), x->ty->sz);
     
 }
 
@@ -123,12 +62,14 @@ std::string sized(std::string x, int sz) {
     if (sz & (sz - 1) || sz > 8)
         return "UNSUPPORTED SIZE " + std::to_string(sz);
 
-    if (x == "rbx")
-        return sz == 8 ? "rbx" : sz == 4 ? "ebx" : sz == 2 ? "bx" : "bl";
-    if (x == "rdi")
-        return sz == 8 ? "rdi" : sz == 4 ? "ebx" : sz == 2 ? "di" : "dil";
-    
-    return x + (sz == 8 ? "" : sz == 4 ? "d" : sz == 2 ? "w" : "b");
+    if (isdigit(x[1]))
+        return x + (sz == 8 ? "" : sz == 4 ? "d" : sz == 2 ? "w" : "b");
+
+    // rax, rbx, rcx, rdx, rsi and rdi
+    std::string low = x.substr(1);
+    if (sz == 1)
+        return low[1] == 'x' ? low.substr(0, 1) + "l" : low + "l";
+    return sz == 8 ? x : sz == 4 ? "e" + low : low;
 }
 
 // We assume i < 6.
@@ -143,81 +84,179 @@ std::string reg_arg(int i, int sz = 8) {
     return (sz == 8 ? rs8 : sz == 4 ? rs4 : sz == 2 ? rs2 : rs1)[i];
 }
 
-bool spilt(ir* x) {
-    return x->a0 && x->a0->spilt || x->a1 && x->a1->spilt;
+// Where the value of r lives; spilt registers are read from their stack slot.
+std::string operand(reg* r) {
+    if (r->spilt)
+        return format("qword [rbp{}]", r->dest->offset);
+    return regs[r->real];
 }
 
-void assemble_func(std::ostream& os, func* f, std::vector<ir*>& irs, bool reassigned = false) {
-    for (auto x : irs) {
-        auto r0 = regs[x->a0 ? x->a0->real : 0];
-        auto r1 = regs[x->a1 ? x->a1->real : 0];
-
-        // Allocate spilt registers
-        // We do not do this in tidy_registers(), because
-        // it might assign to the same register twice,
-        // in difference instructions
-        if (spilt(x) && !reassigned) {
-            std::vector<ir*> sp;
-            if (x->a0 && x->a0->spilt) {
-                x->a0->real = rsz - 2;
-                sp.push_back(new ir(I_SPILL_LOAD, regs[rsz - 2], x->a0->dest));
-            }
-            if (x->a1 && x->a1->spilt) {
-                sp.push_back(new ir(I_SPILL_LOAD, regs[rsz - 1], x->a1->dest));
-                if (x->a0 != x->a1)
-                    x->a1->real = rsz - 1;
-            }
-
-            sp.push_back(x);
+// The memory operand of a load or store, whose address register is base.
+std::string address(ir* x, reg* base) {
+    std::string s;
+    long disp = x->imm;
+    if (!x->v)
+        s = regs[base->real];
+    else if (x->v->is_global)
+        s = name_of(x->v->name);
+    else {
+        s = "rbp";
+        disp += x->v->offset;
+    }
+    if (x->a2)
+        s += format(" + {}*{}", regs[x->a2->real], x->scale);
+    if (disp)
+        s += format("{:+}", disp);
+    return "[" + s + "]";
+}
 
-            if (x->a0 && x->a0->spilt)
-                sp.push_back(new ir(I_SPILL_STORE, regs[rsz - 2], x->a0->dest));
+// The memory that load x reads, with its size.
+std::string memory(ir* x) {
+    static std::string ptr[] = { "", "byte", "word", "", "dword", "", "", "", "qword" };
+    return ptr[x->sz] + " " + address(x, x->a1);
+}
 
-            assemble_func(os, f, sp, true);
-            continue;
+// Real registers the function uses
+int used_regs;
+
+// Jump tables of the function, which go to .rodata after it
+std::vector<std::string> tables;
+
+// Emits moves happening at once, as (destination, source).
+// Destinations must be registers; a cycle is broken through rax, which must be free.
+void parallel_move(std::ostream& os, std::vector<std::pair<std::string, std::string>> mv) {
+    mv.erase(std::remove_if(mv.begin(), mv.end(), [](auto& m) { return m.first == m.second; }), mv.end());
+    while (!mv.empty()) {
+        bool progress = false;
+        for (int i = 0; i < mv.size(); i++) {
+            bool blocked = false;
+            for (int j = 0; j < mv.size(); j++)
+                blocked |= j != i && mv[j].second == mv[i].first;
+            if (blocked)
+                continue;
+            os << format("\tmov {}, {}\n", mv[i].first, mv[i].second);
+            mv.erase(mv.begin() + i);
+            progress = true;
+            break;
         }
-        
+        if (progress)
+            continue;
+
+        os << format("\tmov rax, {}\n", mv[0].second);
+        mv[0].second = "rax";
+    }
+}
+
+// Emits r0 = r1 op r2, where r2 may be in memory.
+void binary(std::ostream& os, const char* op, std::string r0, std::string r1, std::string r2, bool commutative) {
+    // r2 reads r0, which is overwritten first otherwise; no register name is a prefix of another
+    if (r0 != r1 && r2.find(r0) != std::string::npos) {
+        if (r0 != r2)
+            os << format("\tmov {}, {}\n", r0, r2);
+        if (commutative)
+            os << format("\t{} {}, {}\n", op, r0, r1);
+        else // Only sub is not commutative
+            os << format("\tneg {}\n", r0)
+            << format("\tadd {}, {}\n", r0, r1);
+        return;
+    }
+    if (r0 != r1)
+        os << format("\tmov {}, {}\n", r0, r1);
+    os << format("\t{} {}, {}\n", op, r0, r2);
+}
+
+// Assembles instructions of a block.
+// next is the block placed after it, which needs no jump to reach.
+void assemble_func(std::ostream& os, func* f, std::vector<ir*>& irs, block* next) {
+    for (auto x : irs) {
+        std::string r0 = regs[x->a0 ? x->a0->real : 0];
+        std::string r1 = regs[x->a1 ? x->a1->real : 0];
+        // The second operand may be an immediate
+        std::string r2 = x->a2 ? regs[x->a2->real] : std::to_string(x->imm);
+        // Either operand may be in memory
+        if (x->mem && x->ty != I_RMW)
+            (x->a1 ? r2 : r1) = memory(x->mem);
+
         switch (x->ty) {
         case I_IMM:
             os << format("\tmov {}, {}\n", r0, x->imm);
             break;
         case I_ADD:
-            os << format("\tadd {}, {}\n", r0, r1);
-            break;
-        case I_SUB:
-            os << format("\tsub {}, {}\n", r0, r1);
+        case I_SUB: {
+            long disp = x->ty == I_ADD ? x->imm : -x->imm;
+            // lea saves the copy
+            if (!x->a2 && !x->mem && r0 != r1 && disp >= INT_MIN && disp <= INT_MAX)
+                os << format("\tlea {}, [{}{:+}]\n", r0, r1, disp);
+            else if (!x->a2 && !x->mem && (disp == 1 || disp == -1))
+                os << format("\t{} {}\n", disp == 1 ? "inc" : "dec", r0);
+            else
+                binary(os, x->ty == I_ADD ? "add" : "sub", r0, r1, r2, x->ty == I_ADD);
             break;
+        }
         case I_IMUL:
-            os << format("\tmov rax, {}\n", r0)
-            << format("\timul {}\n", r1)
-            << format("\tmov {}, rax\n", r0);
+            if (x->a2 || x->mem)
+                binary(os, "imul", r0, r1, r2, true);
+            else
+                os << format("\timul {}, {}, {}\n", r0, r1, x->imm);
             break;
-        case I_IDIV:
-            os << format("\tmov rax, {}\n", r0)
-            << "\tcqo\n"
-            << format("\tidiv {}\n", r1)
-            << format("\tmov {}, rax\n", r0);
+        case I_SHL:
+        case I_SAR:
+        case I_SHR:
+            if (r0 != r1)
+                os << format("\tmov {}, {}\n", r0, r1);
+            os << format("\t{} {}, {}\n", x->ty == I_SHL ? "shl" : x->ty == I_SAR ? "sar" : "shr", r0, x->imm);
+            break;
+        case I_LEA:
+            os << format("\tlea {}, [{} + {}*{}{}]\n", r0, r1, r2, x->scale, x->imm ? format("{:+}", x->imm) : "");
+            break;
+        case I_MULHI:
+            // The allocator keeps rax and rdx free of anything else here
+            if (r1 == "rax")
+                os << format("\tmov rdx, {}\n", x->imm)
+                << "\timul rdx\n";
+            else
+                os << format("\tmov rax, {}\n", x->imm)
+                << format("\timul {}\n", r1);
+            if (r0 != "rdx")
+                os << format("\tmov {}, rdx\n", r0);
             break;
-        case I_MOD:
-            os << format("\tmov rax, {}\n", r0)
-            << "\tcqo\n"
-            << format("\tidiv {}\n", r1)
-            << format("\tmov {}, rdx\n", r0);
+        case I_IDIV:
+        case I_MOD: {
+            // The allocator keeps rax and rdx free of anything else here
+            std::string res = x->ty == I_IDIV ? "rax" : "rdx";
+            if (r1 != "rax")
+                os << format("\tmov rax, {}\n", r1);
+            os << "\tcqo\n"
+            << format("\tidiv {}\n", r2);
+            if (r0 != res)
+                os << format("\tmov {}, {}\n", r0, res);
             break;
+        }
         case I_LE:
         case I_GE:
         case I_LEQ:
         case I_GEQ:
         case I_NEQ:
         case I_EQ:
-            os << format("\tcmp {}, {}\n", r0, r1)
+            os << format("\tcmp {}, {}\n", r1, r2)
             << format("\t{} {}\n", cmpmap[x->ty], sized(r0, 1))
             << format("\tmovzx {}, {}\n", r0, sized(r0, 1));
             break;
+        case I_MOV:
+            if (r0 != r1)
+                os << format("\tmov {}, {}\n", r0, r1);
+            break;
+        case I_SEXT:
+            os << format("\tmovsx {}, {}\n", r0, sized(r1, x->sz));
+            break;
+        case I_ARG:
+            if (r0 != reg_arg(x->imm))
+                os << format("\tmov {}, {}\n", r0, reg_arg(x->imm));
+            break;
         case I_RET:
-            if (x->a0)
+            if (x->a0 && r0 != "rax")
                 os << format("\tmov rax, {}\n", r0);
-            os << format("\tjmp .Lfunc_end_{}\n", f->name);
+            os << format("\tjmp .Lfunc_end_{}\n", name_of(f->name));
             break;
         case I_LOCALREF: {
             std::string off = std::to_string(x->v->offset);
@@ -225,67 +264,114 @@ void assemble_func(std::ostream& os, func* f, std::vector<ir*>& irs, bool reassi
             break;
         }
         case I_GLOBALREF:
-            os << format("\tlea {}, {}\n", r0, x->v->name);
+            os << format("\tlea {}, {}\n", r0, name_of(x->v->name));
             break;
         case I_STORE:
-            os << format("\tmov [{}], {}\n", r0, sized(r1, x->sz));
+            os << format("\tmov {}, {}\n", address(x, x->a0), sized(r1, x->sz));
             break;
-        case I_LOAD:
-            os << format("\tmov {}, [{}]\n", sized(r0, x->sz), r1);
-            // In case the front bits of r0 has been used and not emptied
-            if (x->sz != 8)
-                os << format("\tmovsx {}, {}\n", r0, sized(r0, x->sz));
+        case I_RMW: {
+            long disp = x->op == I_ADD ? x->imm : -x->imm;
+            if (!x->a1 && (disp == 1 || disp == -1))
+                os << format("\t{} {}\n", disp == 1 ? "inc" : "dec", memory(x->mem));
+            else
+                os << format("\t{} {}, {}\n", x->op == I_ADD ? "add" : "sub", memory(x->mem),
+                    x->a1 ? sized(r1, x->mem->sz) : std::to_string(x->imm));
             break;
+        }
+        case I_LOAD: {
+            // Narrower values are sign-extended as they are loaded
+            std::string mem = address(x, x->a1);
+            if (x->sz == 8)
+                os << format("\tmov {}, {}\n", r0, mem);
+            else
+                os << format("\t{} {}, {} {}\n", x->sz == 4 ? "movsxd" : "movsx", r0,
+                    x->sz == 4 ? "dword" : x->sz == 2 ? "word" : "byte", mem);
+            break;
+        }
         case I_SPILL_STORE:
-            os << format("\tmov [rbp{}], {}\n", x->v->offset, x->name);
+            os << format("\tmov [rbp{}], {}\n", x->v->offset, r0);
             break;
         case I_SPILL_LOAD:
-            os << format("\tmov {}, [rbp{}]\n", x->name, x->v->offset);
+            os << format("\tmov {}, [rbp{}]\n", r0, x->v->offset);
             break;
         case I_CALL: {
             int sz = x->params.size();
+
+            // Caller-saved registers holding values needed after the call
+            std::vector<std::string> saved;
+            for (int i = 0; i < callee_saved; i++)
+                if (x->saved >> i & 1)
+                    saved.push_back(regs[i]);
+            for (auto r : saved)
+                os << format("\tpush {}\n", r);
+
+            // Push excessive arguments to the stack, the last one first.
+            // rsp must still be a multiple of 16 at the call
+            int extra = std::max(0, sz - 6);
+            if ((extra + saved.size()) % 2) {
+                os << "\tsub rsp, 8\n";
+                extra++;
+            }
+            for (int i = sz - 1; i >= 6; i--)
+                os << format("\tpush {}\n", operand(x->params[i]));
+
+            // Arguments may sit in each other's registers.
+            // rax is no argument register, so it is read before any cycle goes through it
+            std::vector<std::pair<std::string, std::string>> mv;
             for (int i = 0; i < std::min(6, sz); i++)
-                os << format("\tmov {}, {}\n", reg_arg(i), regs[x->params[i]->real]);
-            
+                mv.push_back({ reg_arg(i), operand(x->params[i]) });
+            parallel_move(os, mv);
+
             // Variadic function must pass excessive argument amount to %al
             os << format("\tmov al, {}\n", x->imm);
-            
-            // Caller-preserved registers
-            os << "\tpush r10\n\tpush r11\n";
-
-            // Push excessive arguments to the stack
-            for (int i = std::min(6, sz); i < sz; i++)
-                os << format("\tpush {}\n", regs[x->params[i]->real]);
 
             os << format("\tcall {}\n", x->name);
 
             // Clear arguments pushed to the stack
-            if (sz > 6)
-                os << format("\tadd rsp, {}\n", (sz - 6) * 8);
-
-            os << "\tpop r11\n\tpop r10\n";
+            if (extra)
+                os << format("\tadd rsp, {}\n", extra * 8);
 
-            os << format("\tmov {}, rax\n", r0);
+            if (r0 != "rax")
+                os << format("\tmov {}, rax\n", r0);
 
+            for (int i = saved.size() - 1; i >= 0; i--)
+                os << format("\tpop {}\n", saved[i]);
             break;
         }
-        case I_IF:
-            os << format("\tcmp {}, 0\n", r0)
-            << format("\tje .Lif_{}_unhit\n", x->imm);
-            break;    
-        case I_WHILE:
-            os << format("\tcmp {}, 0\n", r0)
-            << format("\tje .Lwhile_{}_end\n", x->imm);
+        case I_JMP:
+            if (x->to != next)
+                os << format("\tjmp .Lbb_{}\n", x->to->id);
             break;
-        case I_FOR:
-            os << format("\tcmp {}, 0\n", r0)
-            << format("\tje .Lfor_{}_end\n", x->imm);
+        case I_BR: {
+            auto [jcc, njcc] = x->a0 ? MAPPED("jne", "je") : jmpmap[x->cmp];
+            if (x->a0)
+                os << format("\tcmp {}, 0\n", r0);
+            else
+                os << format("\tcmp {}, {}\n", r1, r2);
+
+            if (x->to == next)
+                os << format("\t{} .Lbb_{}\n", njcc, x->els->id);
+            else {
+                os << format("\t{} .Lbb_{}\n", jcc, x->to->id);
+                if (x->els != next)
+                    os << format("\tjmp .Lbb_{}\n", x->els->id);
+            }
             break;
-        case I_RAW:
-            if (x->name[0] != '.')
-                os << "\t";
-            os << x->name << "\n";
+        }
+        case I_SWITCH: {
+            // Negative indices are taken as large unsigned ones, so one check suffices
+            static int cnt = 0;
+            std::string label = format(".Ljt_{}", cnt++);
+            os << format("\tcmp {}, {}\n", r0, x->table.size() - 1)
+            << format("\tja .Lbb_{}\n", x->els->id)
+            << format("\tjmp qword [{} + {}*8]\n", label, r0);
+
+            std::string t = label + ": dq ";
+            for (int i = 0; i < x->table.size(); i++)
+                t += format("{}.Lbb_{}", i ? ", " : "", x->table[i]->id);
+            tables.push_back(t);
             break;
+        }
         default:
             throw x->ty;
         }
@@ -293,42 +379,54 @@ void assemble_func(std::ostream& os, func* f, std::vector<ir*>& irs, bool reassi
 }
 
 void assemble(std::ostream& os, decltype(generate())& irs) {
-    assemble_var(os);
+    std::unordered_set<var*> used;
+    for (auto& [f, bs] : irs)
+        for (auto b : bs)
+            for (auto x : b->irs) {
+                used.insert(x->v);
+                if (x->mem)
+                    used.insert(x->mem->v);
+            }
+    assemble_var(os, used);
     os << "\n";
 
-    // List of callee-preserved registers we use
-    static std::string hold[] = { "r12", "r13", "r14", "r15", "rbx" };
-
     for (auto& [f, i] : irs) {
         // Case: Declaration only
         if (i.empty()) {
-            os << format("extern {}\n", f->name);
+            os << format("extern {}\n", name_of(f->name));
             continue;
         }
 
-        // Tidy registers before anything happens,
+        // Allocate registers before anything happens,
         // since this changes the vector<ir*>
-        // Also records how many registers we used that we have to preserve
-        int amt = tidy_register(f, i);
+        used_regs = allocate(f, i);
+
+        // Callee-saved registers we use, which we have to preserve
+        std::vector<std::string> hold;
+        for (int i = callee_saved; i < rsz; i++)
+            if (used_regs >> i & 1)
+                hold.push_back(regs[i]);
+        int amt = hold.size();
 
         // Case: Definition
-        os << format("section .text\nglobal {}\n{}:\n", f->name, f->name) <<
+        os << format("section .text\nglobal {}\n{}:\n", name_of(f->name), name_of(f->name)) <<
         "\tpush rbp\n"
         "\tmov rbp, rsp\n";
 
         // Assign an offset to all local variables
         int offset = 0, off_param = 8;
-        for (auto v : f->v->vars) {
+        for (auto v : f->frame) {
             if (v->is_param)
                 continue;
             v->offset = -(offset += v->ty->sz);
         }
         for (int i = 0; i < f->params.size(); i++) {
             var* v = f->params[i];
-            if (i < 6)
-                v->offset = -(offset += v->ty->sz);
-            else
+            if (i >= 6)
                 v->offset = off_param += 8; // Every push grows stack by 8 bytes
+            // Parameters promoted to registers need no slot
+            else if (std::find(f->frame.begin(), f->frame.end(), v) != f->frame.end())
+                v->offset = -(offset += v->ty->sz);
         }
         
         // rsp must get aligned to a multiple to 16 by calling convention
@@ -343,15 +441,12 @@ void assemble(std::ostream& os, decltype(generate())& irs) {
         for (int i = 0; i < amt; i++)
             os << format("\tpush {}\n", hold[i]);
 
-        // Copy arguments to stack
-        for (int i = 0; i < f->params.size() & i < 6; i++) {
-            var* v = f->params[i];
-            os << format("\tmov [rbp{}], {}\n", v->offset, reg_arg(i, v->ty->sz));
+        for (int k = 0; k < i.size(); k++) {
+            os << format(".Lbb_{}:\n", i[k]->id);
+            assemble_func(os, f, i[k]->irs, k + 1 < i.size() ? i[k + 1] : nullptr);
         }
 
-        assemble_func(os, f, i);
-
-        os << format(".Lfunc_end_{}:\n", f->name);
+        os << format(".Lfunc_end_{}:\n", name_of(f->name));
         
         for (int i = amt - 1; i >= 0; i--)
             os << format("\tpop {}\n", hold[i]);
@@ -360,5 +455,12 @@ void assemble(std::ostream& os, decltype(generate())& irs) {
         "\tmov rsp, rbp\n"
         "\tpop rbp\n"
         "\tret\n";
+
+        if (!tables.empty()) {
+            os << "section .rodata\n";
+            for (auto& t : tables)
+                os << t << "\n";
+            tables.clear();
+        }
     }
 }
\ No newline at end of file
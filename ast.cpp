@@ -1,65 +1,112 @@
 #include "ast.h"
 #include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <tuple>
 #define MAPPED std::make_pair
 
 std::vector<func*> funcs;
 
+int node::count = 0;
+
 node::node(node_type ty, int val):
-    ty(ty), val(val), is_lval(false) { }
+    ty(ty), is_lval(false), ignore_const(false), val(val), cty(nullptr), lhs(nullptr), rhs(nullptr), cond(nullptr) { count++; }
 
 node::node(node_type ty, node* lhs, node* rhs):
-    ty(ty), lhs(lhs), rhs(rhs), is_lval(false) { }
+    ty(ty), is_lval(false), ignore_const(false), val(0), cty(nullptr), lhs(lhs), rhs(rhs), cond(nullptr) {
+    if (ty == N_BLOCK || ty == N_FCALL)
+        nodes = make<std::vector<node*>>();
+    count++;
+}
 
 node::node(node_type ty, var* target, node* rhs):
-    ty(ty), target(target), rhs(rhs), is_lval(false) { }
+    ty(ty), is_lval(false), ignore_const(false), val(0), cty(nullptr), target(target), rhs(rhs), cond(nullptr) { count++; }
 
-env::env(env* father): father(father) { }
 
-type::type(int ty): ty(ty), sz(get_size(ty)), is_const(false) { }
+type::type(int ty): ty(ty), sz(get_size(ty)), ptr_to(nullptr), asz(0), ret(nullptr), is_const(false), plain(this) { }
 
-type* type::ptr(type* p) {
-    type* t = new type(K_MUL);
-    t->ptr_to = p;
-    t->sz = 8;
-    t->is_const = false;
+// Everything that tells two types apart.
+using type_key = std::tuple<int, type*, int, type*, std::vector<type*>, bool>;
+
+std::map<type_key, type*> types;
+
+type* type::get(int ty, type* ptr_to, int asz, type* ret, const std::vector<type*>& params, bool is_const) {
+    type*& t = types[{ ty, ptr_to, asz, ret, params, is_const }];
+    if (t)
+        return t;
+
+    t = make<type>(ty);
+    t->ptr_to = ptr_to;
+    t->asz = asz;
+    t->ret = ret;
+    t->params = params;
+    t->is_const = is_const;
+    if (ty == K_LBRACKET)
+        t->sz = asz * ptr_to->sz;
+    if (ty == K_LPARENS)
+        t->sz = 8;
+
+    // Arrays and functions are inherently const
+    bool inherent = ty == K_LBRACKET || ty == K_LPARENS;
+    type* pt = ptr_to ? ptr_to->plain : nullptr;
+    type* rt = ret ? ret->plain : nullptr;
+    std::vector<type*> pp;
+    for (auto p : params)
+        pp.push_back(p->plain);
+
+    if (pt != ptr_to || rt != ret || pp != params || is_const != inherent)
+        t->plain = get(ty, pt, asz, rt, pp, inherent);
     return t;
 }
 
+type* type::of(int ty, bool is_const) {
+    return get(ty, nullptr, 0, nullptr, {}, is_const);
+}
+
+type* type::ptr(type* p) {
+    return get(K_MUL, p, 0, nullptr, {}, false);
+}
+
 type* type::arr(type* p, int sz) {
-    type* t = new type(K_LBRACKET);
-    t->ptr_to = p;
-    t->asz = sz;
-    t->sz = sz * p->sz;
-    t->is_const = true;
-    return t;
+    return get(K_LBRACKET, p, sz, nullptr, {}, true);
 }
 
 type* type::fn(type* ret, std::vector<type*> param) {
-    type* t = new type(K_LPARENS);
-    t->params = param;
-    t->ret = ret;
-    t->sz = 8;
-    t->is_const = true;
-    return t;
+    return get(K_LPARENS, nullptr, 0, ret, param, true);
 }
 
-void env::push(var* v) {
-    vars.push_back(v);
-    if (father && father != global)
-        father->push(v);
+type* type::qualified(type* t) {
+    return get(t->ty, t->ptr_to, t->asz, t->ret, t->params, true);
 }
 
-bool type::operator==(type x) {
-    if (x.ty == K_MUL && ty == K_MUL)
-        return *x.ptr_to == *ptr_to;
-    
-    return ty == x.ty;
+type* const type::int_t = type::of(K_INT);
+type* const type::long_t = type::of(K_LONG);
+type* const type::char_t = type::of(K_CHAR);
+type* const type::short_t = type::of(K_SHORT);
+type* const type::void_t = type::of(K_VOID);
+
+void scope_table::push() {
+    scopes.emplace_back();
 }
 
-bool type::operator!=(type x) {
-    return !(*this == x);
+void scope_table::pop() {
+    for (auto s : scopes.back())
+        decls[s].pop_back();
+    scopes.pop_back();
+}
+
+void scope_table::declare(var* v) {
+    if (v->name >= decls.size())
+        decls.resize(v->name + 1);
+    decls[v->name].push_back(v);
+    scopes.back().push_back(v->name);
+}
+
+var* scope_table::lookup(symbol name) {
+    if (name >= decls.size() || decls[name].empty())
+        return nullptr;
+    return decls[name].back();
 }
 
 int type::get_size(int x) {
@@ -74,9 +121,15 @@ int type::get_size(int x) {
     return szof[x];
 }
 
-// The environment we are currently in.
-env* envi = nullptr;
-env* const global = new env;
+std::vector<var*> globals;
+
+scope_table names;
+// The function we are currently parsing.
+func* curr_func = nullptr;
+// Switches we are in, the innermost last
+std::vector<node*> switches;
+// Number of loops we are in
+int loops = 0;
 
 // Determines if the next token is a type name.
 // Does not consume.
@@ -84,9 +137,9 @@ bool is_type() {
     static token_type tys[] = {
         K_INT, K_CHAR, K_LONG, K_SHORT, K_VOID
     };
-    token_type t = tin.peek().ty;
+    token_type t = tin.peek();
 
-    if (std::find(tys, tys + sizeof tys, t) != tys + sizeof tys)
+    if (std::find(std::begin(tys), std::end(tys), t) != std::end(tys))
         return true;
     return false;
 }
@@ -97,9 +150,9 @@ bool is_cv_type() {
     static token_type cv[] = {
         K_CONST
     };
-    token_type t = tin.peek().ty;
+    token_type t = tin.peek();
 
-    if (std::find(cv, cv + sizeof cv, t) != cv + sizeof cv)
+    if (std::find(std::begin(cv), std::end(cv), t) != std::end(cv))
         return true;
     return is_type();
 }
@@ -109,28 +162,27 @@ bool is_int_type(type* t) {
         K_INT, K_CHAR, K_LONG, K_SHORT
     };
 
-    if (std::find(tys, tys + sizeof tys, t->ty) != tys + sizeof tys)
+    if (std::find(std::begin(tys), std::end(tys), t->ty) != std::end(tys))
         return true;
     return false;
 }
 
-void qualify(type* ty) {
+type* qualify(type* ty) {
     while (test(K_CONST))
-        ty->is_const = true;
+        ty = type::qualified(ty);
+    return ty;
 }
 
 type* type_spec() {
-    type* res = new type;
-
-    qualify(res);
+    bool is_const = false;
+    while (test(K_CONST))
+        is_const = true;
     if (!is_type())
         throw unexpected_token("Type not recognised");
-    token t = tin.consume();
-    res->ty = t.ty;
-    res->sz = type::get_size(t.ty);
-    qualify(res);
+    token_type t = tin.kind(tin.consume());
 
-    return res;
+    type* res = type::of(t, is_const);
+    return qualify(res);
 }
 
 // For function return types.
@@ -142,9 +194,9 @@ type* read_ptr() {
     return ty;
 }
 
-type* decl(type*, std::string&);
-type* full_decl(std::string&);
-type* direct_decl(type* base, std::string& name) {
+type* decl(type*, symbol&);
+type* full_decl(symbol&);
+type* direct_decl(type* base, symbol& name) {
     bool delayed = false;
     int ret_point = 0;
     if (test(K_LPARENS)) {
@@ -153,14 +205,10 @@ type* direct_decl(type* base, std::string& name) {
             tin.consume();
         delayed = true;
     }
-    type* ty = base;
-    qualify(ty);
+    type* ty = qualify(base);
 
-    token t = tin.peek();
-    if (t.ty == K_IDENT) {
-        name = t.ident;
-        tin.consume();
-    }
+    if (tin.peek() == K_IDENT)
+        name = tin.val(tin.consume());
     
     bool is_array = false;
     while (test(K_LBRACKET)) {
@@ -170,12 +218,12 @@ type* direct_decl(type* base, std::string& name) {
             continue;
         }
         
-        token t = tin.consume();
-        if (t.ty != K_NUM)
+        int t = tin.consume();
+        if (tin.kind(t) != K_NUM)
             throw unexpected_token("Array length must be constant");
-        if (t.val <= 0)
+        if (tin.val(t) <= 0)
             throw unexpected_token("Expected positive array length");
-        ty = type::arr(ty, t.val);
+        ty = type::arr(ty, tin.val(t));
         expect(K_RBRACKET);
     }
     
@@ -185,9 +233,9 @@ type* direct_decl(type* base, std::string& name) {
     if (test(K_LPARENS) && !test(K_RPARENS)) {
         std::vector<type*> param;
         do {
-            std::string no_name;
+            symbol no_name = 0;
             type* t = full_decl(no_name);
-            if (no_name != "")
+            if (no_name)
                 throw unexpected_token("Arguments can't be named for function pointers");
             param.push_back(t);
         } while (test(K_COMMA));
@@ -208,7 +256,7 @@ type* direct_decl(type* base, std::string& name) {
     return ty;
 }
 
-type* decl(type* base, std::string& name) {
+type* decl(type* base, symbol& name) {
     type* ty = base;
     while (test(K_MUL))
         ty = type::ptr(ty);
@@ -216,15 +264,15 @@ type* decl(type* base, std::string& name) {
     return direct_decl(ty, name);
 }
 
-type* full_decl(std::string& name) {
+type* full_decl(symbol& name) {
     type* base = type_spec();
     return decl(base, name);
 }
 
 var* get_var(bool must_name = true) {
-    var* v = new var;
+    var* v = make<var>();
     v->ty = full_decl(v->name);
-    if (must_name && v->name == "")
+    if (must_name && !v->name)
         throw unexpected_token("Expected variable name");
     return v;
 }
@@ -232,28 +280,34 @@ var* get_var(bool must_name = true) {
 // If base is null, then fulfuill base;
 // If not, then take base as granted and do not call type_spec()
 var* get_base_var(type*& base) {
-    var* v = new var;
+    var* v = make<var>();
 
     if (!base)
         base = type_spec();
     v->ty = decl(base, v->name);
-    if (v->name == "")
+    if (!v->name)
         throw unexpected_token("Expected variable name");
     return v;
 }
 
-var* resolve(std::string name) {
-    for (env* b = envi; b; b = b->father)
-        for (auto v : b->vars)
-            if (v->name == name)
-                return v;
+var* resolve(symbol name) {
+    if (var* v = names.lookup(name))
+        return v;
     
     throw unexpected_token("Variable name resolution failed");
 }
 
+// Declares a local variable in current scope and gives it a stack slot.
+void declare_local(var* v) {
+    names.declare(v);
+    curr_func->frame.push_back(v);
+}
+
 node* expr();
 node* primary() {
     static int str_cnt = 0;
+    // Identical string literals share one global
+    static std::map<symbol, var*> strs;
 
     if (test(K_LPARENS)) {
         node* t = expr();
@@ -261,17 +315,17 @@ node* primary() {
         return t;
     }
 
-    if (tin.peek().ty == K_IDENT) {
-        token t = tin.consume();
+    if (tin.peek() == K_IDENT) {
+        symbol name = tin.val(tin.consume());
 
         // Function call
         if (test(K_LPARENS)) {
-            node* k = new node(N_FCALL);
+            node* k = make<node>(N_FCALL);
 
-            k->name = t.ident;
+            k->name = name;
 
             if (!test(K_RPARENS)) {
-                do k->nodes.push_back(expr()); while (test(K_COMMA));
+                do k->nodes->push_back(expr()); while (test(K_COMMA));
                 expect(K_RPARENS);
             }
 
@@ -279,49 +333,54 @@ node* primary() {
         }
 
         // Variable reference
-        return new node(N_VARREF, resolve(t.ident));
+        return make<node>(N_VARREF, resolve(name));
     }
 
-    token x = tin.consume();
+    int x = tin.consume();
 
     // String literal
-    if (x.ty == K_STR) {
-        var* v = new var;
-        v->name = "__builtin_str_" + std::to_string(++str_cnt);
-        v->ty = new type(K_CHAR);
-        v->is_strlit = true;
-        v->is_global = true;
-        v->value = x.ident;
-        global->push(v);
-        return new node(N_ADDR, new node(N_VARREF, v));
+    if (tin.kind(x) == K_STR) {
+        var*& v = strs[tin.val(x)];
+        if (!v) {
+            v = make<var>();
+            v->name = intern("__builtin_str_" + std::to_string(++str_cnt));
+            v->ty = type::char_t;
+            v->is_strlit = true;
+            v->is_global = true;
+            v->value = tin.val(x);
+            globals.push_back(v);
+        }
+        return make<node>(N_ADDR, make<node>(N_VARREF, v));
     }
 
     // Numeric literal
-    if (x.ty == K_NUM)
-        return new node(N_NUM, x.val);
+    if (tin.kind(x) == K_NUM)
+        return make<node>(N_NUM, tin.val(x));
 
     throw unexpected_token("Unexpected primary()");
 }
 
 node* unary() {
-    token k = tin.peek();
+    token_type k = tin.peek();
     if (test(K_PP) || test(K_MM)) {
         node* t = unary();
         if (t->ty != N_VARREF)
             throw unexpected_token("Expected identifier after ++/--");
         else
-            return new node(k.ty == K_PP ? N_PLUSEQ : N_MINUSEQ, t, new node(N_NUM, 1));
+            return make<node>(k == K_PP ? N_PLUSEQ : N_MINUSEQ, t, make<node>(N_NUM, 1));
     }
 
     if (test(K_MINUS))
-        return new node(N_MINUS, new node(N_NUM, 0), unary());
+        return make<node>(N_MINUS, make<node>(N_NUM, 0), unary());
     if (test(K_PLUS))
         return unary(); // Can't ignore here; otherwise (+- -+2) will not work
 
     if (test(K_MUL))
-        return new node(N_DEREF, unary());
+        return make<node>(N_DEREF, unary());
     if (test(K_AND))
-        return new node(N_ADDR, unary());
+        return make<node>(N_ADDR, unary());
+    if (test(K_NOT))
+        return make<node>(N_NOT, unary());
 
     node* t = primary();
     
@@ -331,12 +390,12 @@ node* unary() {
         if (t->ty != N_VARREF)
             throw unexpected_token("Expected identifier before ++/--");
         else
-            return new node(k.ty == K_PP ? N_POSTINC : N_POSTDEC, t);
+            return make<node>(k == K_PP ? N_POSTINC : N_POSTDEC, t);
     // Left grouping, same as +-*/%
     while (test(K_LBRACKET)) {
         node* rhs = expr();
         expect(K_RBRACKET);
-        t = new node(N_DEREF, new node(N_PLUS, t, rhs));
+        t = make<node>(N_DEREF, make<node>(N_PLUS, t, rhs));
     }
 
     return t;
@@ -345,9 +404,9 @@ node* unary() {
 node* factor() {
     node* t = unary();
 
-    for (token_type ty = tin.peek().ty; ty == K_MUL || ty == K_DIV || ty == K_MOD; ty = tin.peek().ty) {
+    for (token_type ty = tin.peek(); ty == K_MUL || ty == K_DIV || ty == K_MOD; ty = tin.peek()) {
         tin.consume();
-        t = new node(ty == K_MUL ? N_MUL : ty == K_DIV ? N_DIV : N_MOD, t, unary());
+        t = make<node>(ty == K_MUL ? N_MUL : ty == K_DIV ? N_DIV : N_MOD, t, unary());
     }
     
     return t;
@@ -356,9 +415,9 @@ node* factor() {
 node* term() {
     node* t = factor();
 
-    for (token_type ty = tin.peek().ty; ty == K_PLUS || ty == K_MINUS; ty = tin.peek().ty) {
+    for (token_type ty = tin.peek(); ty == K_PLUS || ty == K_MINUS; ty = tin.peek()) {
         tin.consume();
-        t = new node(ty == K_PLUS ? N_PLUS : N_MINUS, t, factor());
+        t = make<node>(ty == K_PLUS ? N_PLUS : N_MINUS, t, factor());
     }
     
     return t;
@@ -367,13 +426,13 @@ node* term() {
 node* less() {
     node* t = term();
     if (test(K_LEQ))
-        return new node(N_LEQ, t, term());
+        return make<node>(N_LEQ, t, term());
     if (test(K_GEQ))
-        return new node(N_GEQ, t, term());
+        return make<node>(N_GEQ, t, term());
     if (test(K_LE))
-        return new node(N_LE, t, term());
+        return make<node>(N_LE, t, term());
     if (test(K_GE))
-        return new node(N_GE, t, term());
+        return make<node>(N_GE, t, term());
     
     return t;
 }
@@ -381,27 +440,43 @@ node* less() {
 node* eq() {
     node* t = less();
     if (test(K_EQ))
-        return new node(N_EQ, t, term());
+        return make<node>(N_EQ, t, term());
     if (test(K_NEQ))
-        return new node(N_NEQ, t, term());
+        return make<node>(N_NEQ, t, term());
 
     return t;
 }
 
-node* assign() {
+node* land() {
     node* t = eq();
+    while (test(K_LAND))
+        t = make<node>(N_LAND, t, eq());
+
+    return t;
+}
+
+node* lor() {
+    node* t = land();
+    while (test(K_LOR))
+        t = make<node>(N_LOR, t, land());
+
+    return t;
+}
+
+node* assign() {
+    node* t = lor();
     if (test(K_ASSIGN))
-        return new node(N_ASSIGN, t, expr());
+        return make<node>(N_ASSIGN, t, expr());
     if (test(K_PLUSEQ))
-        return new node(N_PLUSEQ, t, expr());
+        return make<node>(N_PLUSEQ, t, expr());
     if (test(K_MINUSEQ))
-        return new node(N_MINUSEQ, t, expr());
+        return make<node>(N_MINUSEQ, t, expr());
     if (test(K_MULEQ))
-        return new node(N_MULEQ, t, expr());
+        return make<node>(N_MULEQ, t, expr());
     if (test(K_DIVEQ))
-        return new node(N_DIVEQ, t, expr());
+        return make<node>(N_DIVEQ, t, expr());
     if (test(K_MODEQ))
-        return new node(N_MODEQ, t, expr());
+        return make<node>(N_MODEQ, t, expr());
     
     return t;
 }
@@ -415,29 +490,28 @@ node* stmt() {
     if (test(K_RET)) {
         // empty return
         if (test(K_SEMICOLON))
-            return new node(N_RET);
+            return make<node>(N_RET);
 
         node* t = expr();
         expect(K_SEMICOLON);
-        return new node(N_RET, t);
+        return make<node>(N_RET, t);
     }
 
     // Declaration
     if (is_cv_type()) {
         type* base = nullptr;
-        // Note that as long as envi does not change,
-        // this does not influence scope
-        node* r = new node(N_BLOCK);
+        // Note that a block of declarations does not open a scope
+        node* r = make<node>(N_BLOCK);
         var* v;
         
         do {
             v = get_base_var(base);
-            envi->push(v);
+            declare_local(v);
 
             if (test(K_ASSIGN)) {
-                node* t = new node(N_ASSIGN, new node(N_VARREF, v), expr());
+                node* t = make<node>(N_ASSIGN, make<node>(N_VARREF, v), expr());
                 t->ignore_const = true;
-                r->nodes.push_back(t);
+                r->nodes->push_back(t);
             }
 
         } while (test(K_COMMA));
@@ -448,7 +522,7 @@ node* stmt() {
 
     // if-statement
     if (test(K_IF)) {
-        node* t = new node(N_IF);
+        node* t = make<node>(N_IF);
         expect(K_LPARENS);
         t->cond = expr();
         expect(K_RPARENS);
@@ -460,68 +534,126 @@ node* stmt() {
         return t;
     }
 
+    // switch-statement; its labels are statements of their own
+    if (test(K_SWITCH)) {
+        node* t = make<node>(N_SWITCH);
+        expect(K_LPARENS);
+        t->cond = expr();
+        expect(K_RPARENS);
+        t->rhs = make<node>(N_BLOCK);
+
+        switches.push_back(t);
+        t->lhs = stmt();
+        switches.pop_back();
+        return t;
+    }
+
+    if (test(K_CASE)) {
+        if (switches.empty())
+            throw unexpected_token("case outside switch");
+        bool neg = test(K_MINUS);
+        int x = tin.consume();
+        if (tin.kind(x) != K_NUM)
+            throw unexpected_token("Case label must be constant");
+        expect(K_COLON);
+
+        node* t = make<node>(N_CASE, neg ? -tin.val(x) : tin.val(x));
+        switches.back()->rhs->nodes->push_back(t);
+        return t;
+    }
+
+    if (test(K_DEFAULT)) {
+        if (switches.empty())
+            throw unexpected_token("default outside switch");
+        expect(K_COLON);
+
+        node* t = make<node>(N_DEFAULT);
+        switches.back()->rhs->nodes->push_back(t);
+        return t;
+    }
+
+    if (test(K_BREAK)) {
+        if (switches.empty() && !loops)
+            throw unexpected_token("break outside loop or switch");
+        expect(K_SEMICOLON);
+        return make<node>(N_BREAK);
+    }
+
+    if (test(K_CONTINUE)) {
+        if (!loops)
+            throw unexpected_token("continue outside loop");
+        expect(K_SEMICOLON);
+        return make<node>(N_CONTINUE);
+    }
+
     // while-statement
     if (test(K_WHILE)) {
-        node* t = new node(N_WHILE);
+        node* t = make<node>(N_WHILE);
         expect(K_LPARENS);
         t->cond = expr();
         expect(K_RPARENS);
+        loops++;
         t->lhs = stmt();
+        loops--;
         return t;
     }
 
     // for-statement
     if (test(K_FOR)) {
-        node* t = new node(N_FOR);
+        node* t = make<node>(N_FOR);
         expect(K_LPARENS);
 
-        env* old = envi;
-        env* v = new env(envi);
-        envi = v;
+        names.push();
 
-        // init
+        // init; it runs once, so it goes in a block right before the loop
+        node* init = nullptr;
         if (!test(K_SEMICOLON)) {
             // (1) Variable declaration
             if (is_type())
-                t->init = stmt();
+                init = stmt();
             
             // (2) Any other expression
             else {
-                t->init = expr();
+                init = expr();
                 expect(K_SEMICOLON);
             }
-        } else t->init = nullptr;
+        }
 
         // cond
         if (!test(K_SEMICOLON)) {
             t->cond = expr();
             expect(K_SEMICOLON);
-        } else t->cond = new node(N_NUM, 1);
+        } else t->cond = make<node>(N_NUM, 1);
         
         // step
         if (!test(K_RPARENS)) {
-            t->step = expr();
+            t->rhs = expr();
             expect(K_RPARENS);
-        } else t->step = nullptr;
+        }
 
+        loops++;
         t->lhs = stmt();
-        envi = old;
-        return t;
+        loops--;
+        names.pop();
+
+        if (!init)
+            return t;
+        node* r = make<node>(N_BLOCK);
+        *r->nodes = { init, t };
+        return r;
     }
     
     // Block
     if (test(K_LBRACE)) {
-        env* old = envi;
-        env* _new = new env(old);
-        envi = _new;
+        names.push();
 
-        node* t = new node(N_BLOCK);
+        node* t = make<node>(N_BLOCK);
 
         while (!test(K_RBRACE))
             if (auto k = stmt(); k)
-                t->nodes.push_back(k);
+                t->nodes->push_back(k);
         
-        envi = old;
+        names.pop();
         return t;
     }
 
@@ -531,6 +663,9 @@ node* stmt() {
 }
 
 void parse() {
+    // Scope of globals
+    names.push();
+
     while (!test(K_EOF)) {
         if (!is_type())
             throw unexpected_token("Typename expected");
@@ -544,10 +679,11 @@ void parse() {
         tin.load();
 
         if (isfunc) {
-            func* f = new func;
+            func* f = make<func>();
             f->ret = read_ptr();
-            f->name = tin.consume().ident;
-            f->v = envi = new env(global);
+            f->name = tin.val(tin.consume());
+            curr_func = f;
+            names.push();
             expect(K_LPARENS);
             if (!test(K_RPARENS)) {
                 do {
@@ -559,23 +695,23 @@ void parse() {
                     var* v = get_var(false);
                     v->is_param = true;
                     f->params.push_back(v);
-                    f->v->push(v);
+                    declare_local(v);
                 } while (test(K_COMMA));
                 expect(K_RPARENS);
             }
             
             if (test(K_SEMICOLON)) {
                 f->body = nullptr;
-                envi = global;
+                names.pop();
 
                 funcs.push_back(f);
                 continue;
             }
-            if (tin.peek().ty != K_LBRACE)
+            if (tin.peek() != K_LBRACE)
                 throw unexpected_token("Expected {");
                 
             f->body = stmt();
-            envi = global;
+            names.pop();
 
             funcs.push_back(f);
             continue;
@@ -583,7 +719,8 @@ void parse() {
         
         var* v = get_var();
         v->is_global = true;
-        global->vars.push_back(v);
+        globals.push_back(v);
+        names.declare(v);
         expect(K_SEMICOLON);
     }
 }
\ No newline at end of file
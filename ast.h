@@ -1,7 +1,8 @@
 #pragma once
+#include "arena.h"
 #include "lexer.h"
 
-enum node_type {
+enum node_type: unsigned char {
     N_NUM,          // number, eg 0
     N_PLUS,         // +
     N_MINUS,        // -
@@ -31,8 +32,18 @@ enum node_type {
     N_POSTDEC,      // post --
     N_DEREF,        // *p
     N_ADDR,         // &a
+    N_LAND,         // &&
+    N_LOR,          // ||
+    N_NOT,          // !
+    N_SWITCH,       // switch
+    N_CASE,         // case 1:
+    N_DEFAULT,      // default:
+    N_BREAK,        // break
+    N_CONTINUE,     // continue
 };
 
+// Types are hash-consed: each distinct type exists exactly once,
+// so types can be compared by pointer. Never modify a type.
 struct type {
     int ty;
     int sz;
@@ -50,103 +61,138 @@ struct type {
 
     bool is_const;
 
-    explicit type(int=0);
+    // The same type with every const removed.
+    // Two types are the same (ignoring qualifiers) iff their plain types are equal.
+    type* plain;
 
-    bool operator==(type);
-    bool operator!=(type);
+    explicit type(int=0);
 
     static int get_size(int);
+    static type* of(int, bool is_const=false);
     static type* ptr(type*);
     static type* arr(type*, int);
     static type* fn(type*, std::vector<type*>);
+    static type* qualified(type*);
+
+    static type* const int_t;
+    static type* const long_t;
+    static type* const char_t;
+    static type* const short_t;
+    static type* const void_t;
+private:
+    static type* get(int, type*, int, type*, const std::vector<type*>&, bool);
 };
 
+// Compares types, ignoring qualifiers.
+inline bool same_type(type* a, type* b) {
+    return a->plain == b->plain;
+}
+
 struct var {
     type* ty;
-    std::string name;
+    symbol name;
 
     // Only used for string literal
     bool is_strlit;
-    std::string value;
+    symbol value;
     
     bool is_global;
     bool is_param;
 
     int offset;
 
-    var(): is_global(false), is_param(false), is_strlit(false), offset(0) {}
+    var(): name(0), is_global(false), is_param(false), is_strlit(false), offset(0) {}
 };
 
-// Environment
-struct env {
-    env* father;
-    std::vector<var*> vars;
-
-    void push(var*);
-
-    explicit env(env* father=nullptr);
+// Scoped symbol table used for name resolution.
+// Symbols are dense integers, so declarations are indexed by them directly.
+class scope_table {
+    // All visible declarations of each symbol; the innermost one is the last
+    std::vector<std::vector<var*>> decls;
+    // Symbols declared in each open scope
+    std::vector<std::vector<symbol>> scopes;
+public:
+    void push();
+    void pop();
+    void declare(var*);
+
+    // Finds the innermost declaration of the symbol. Returns nullptr if none.
+    var* lookup(symbol);
 };
 
+struct func;
+
 // A node of AST.
+// Fields that no node kind uses together share storage,
+// which keeps a node at 40 bytes.
 struct node {
     node_type ty;
-    
-    // Value of number literals
-    // Value of excessive arguments for a variadic function
-    int val;
-
-    // Operands
-    node* lhs;
-    node* rhs;
-
-    // Target of N_VARREF
-    var* target;
-
-    // For N_BLOCK, this is all statements;
-    // For N_FCALL, this is all parameters
-    std::vector<node*> nodes;
-    
-    // Name of the function to call
-    std::string name;
-
-    // condition of if/while/for
-    node* cond;
-
-    // init and step expression of for
-    // for if/while/for, their block is in lhs
-    // the else block is in rhs
-    node* init;
-    node* step;
-
     // for semantics check
     bool is_lval;
-    // means "type in C"
-    type* cty;
     // for first time assignment
     bool ignore_const;
-    
+
+    union {
+        // Value of number literals
+        int val;
+        // For N_FCALL, name of the function to call
+        symbol name;
+    };
+
+    // means "type in C"
+    type* cty;
+
+    union {
+        // Operands
+        // for if/while/for, their block is in lhs
+        node* lhs;
+        // Target of N_VARREF
+        var* target;
+        // For N_BLOCK, this is all statements;
+        // For N_FCALL, this is all parameters
+        std::vector<node*>* nodes;
+    };
+
+    union {
+        // the else block of if, and the step expression of for
+        // For compound assignment, the operand, which check() sets to 1 for ++ and --
+        // For N_SWITCH, an N_BLOCK of its N_CASE and N_DEFAULT labels
+        node* rhs;
+        // For N_FCALL, the function called; set by check()
+        func* callee;
+    };
+
+    // condition of if/while/for, and the value switch tests
+    // The init expression of for is hoisted in front of it by parser.
+    node* cond;
 
     node(node_type ty, int val);
     node(node_type ty, node* lhs=nullptr, node* rhs=nullptr);
     node(node_type ty, var* target, node* rhs=nullptr);
+
+    // Number of nodes ever created
+    static int count;
 };
 
 struct func {
-    std::string name;
+    symbol name;
     
     node* body;
-    env* v;
     type* ret;
 
     bool is_variadic;
 
     std::vector<var*> params;
 
+    // Every variable needing a stack slot, including those of nested blocks.
+    // The assembler assigns their offsets.
+    std::vector<var*> frame;
+
     func(): is_variadic(false) {}
 };
 
 extern std::vector<func*> funcs;
-extern env* const global;
+extern std::vector<var*> globals;
 
 // Parse the AST from tokens stored in tin.
 // Data is stored in funcs and globals.
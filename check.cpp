@@ -3,20 +3,10 @@
 #include <algorithm>
 #include <numeric>
 #include <map>
-#define MAPPED std::make_pair
+#include <set>
 using fmt::format;
 
-std::map<std::string, std::vector<func*>> fs;
-
-std::map<node_type, node_type> ndmap {
-    MAPPED(N_PLUSEQ, N_PLUS),
-    MAPPED(N_MINUSEQ, N_MINUS),
-    MAPPED(N_MULEQ, N_MUL),
-    MAPPED(N_DIVEQ, N_DIV),
-    MAPPED(N_MODEQ, N_MOD),
-    MAPPED(N_POSTINC, N_PLUSEQ),
-    MAPPED(N_POSTDEC, N_MINUSEQ),
-};
+std::map<symbol, std::vector<func*>> fs;
 
 struct implicit {
     type* t;
@@ -25,7 +15,7 @@ struct implicit {
 };
 
 bool operator==(type* ty, implicit im) {
-    if (*ty == *im.t)
+    if (same_type(ty, im.t))
         return true;
     // int types can arbitrarily convert
     if (is_int_type(ty) && is_int_type(im.t))
@@ -34,7 +24,7 @@ bool operator==(type* ty, implicit im) {
     if (ty->ty == K_MUL && im.t->ty == K_MUL && (im.t->ptr_to->ty == K_VOID || ty->ptr_to->ty == K_VOID))
         return true;
     // T[] converts to T*
-    if (im.t->ty == K_LBRACKET && ty->ty == K_MUL && *im.t->ptr_to == *ty->ptr_to)
+    if (im.t->ty == K_LBRACKET && ty->ty == K_MUL && same_type(im.t->ptr_to, ty->ptr_to))
         return true;
 
     return false;
@@ -48,7 +38,7 @@ bool signature(func* a, func* b) {
         return false;
     
     for (int i = 0; i < ap.size(); i++)
-        if (*ap[i]->ty != *bp[i]->ty)
+        if (!same_type(ap[i]->ty, bp[i]->ty))
             return false;
     
     return true;
@@ -68,22 +58,27 @@ type* infer_type(type* a, type* b) {
         std::swap(a, b);
     assert(is_int_type(a) && is_int_type(b), "Incompatible types of binary operator");
     if (a->sz == 8)
-        return new type(K_LONG);
+        return type::long_t;
     if (a->sz == 4)
-        return new type(K_INT);
+        return type::int_t;
     if (a->sz == 2)
-        return new type(K_SHORT);
+        return type::short_t;
     if (a->sz == 1)
-        return new type(K_CHAR);
+        return type::char_t;
     throw semantic_error("Unknown type error");
 }
 
+// Whether the type can be tested against zero.
+bool is_scalar(type* t) {
+    return is_int_type(t) || t->ty == K_MUL;
+}
+
 void decay(node*& x) {
     if (x->cty->ty != K_LBRACKET)
         return;
     
     // Copy x; otherwise segmentation fault
-    node* z = new node(*x);
+    node* z = make<node>(*x);
     node y(N_ADDR, z);
     y.cty = type::ptr(x->cty->ptr_to);
     *x = y;
@@ -92,13 +87,13 @@ void decay(node*& x) {
 void check_node(func* f, node* x) {    
     switch (x->ty) {
     case N_NUM:
-        x->cty = new type(K_INT);
+        x->cty = type::int_t;
         x->is_lval = false;
         break;
     case N_RET:
         if (!x->lhs) break;
         check_node(f, x->lhs);
-        assert(f->ret == implicit(x->lhs->cty), "Return type error for {}", f->name);
+        assert(f->ret == implicit(x->lhs->cty), "Return type error for {}", name_of(f->name));
         break;
     case N_DEREF:
         check_node(f, x->lhs);
@@ -125,13 +120,13 @@ void check_node(func* f, node* x) {
         // For pointer addition, we need to multiply another operand by the size of underlying type.
         // TODO: add special treatment for function pointers.
         if (x->lhs->cty->ty == K_MUL) {
-            x->rhs = new node(N_MUL, x->rhs, new node(N_NUM, x->lhs->cty->ptr_to->sz));
+            x->rhs = make<node>(N_MUL, x->rhs, make<node>(N_NUM, x->lhs->cty->ptr_to->sz));
             check_node(f, x->rhs);
             assert(is_int_type(x->rhs->cty), "Pointers addition is only compatible with int");
             x->cty = x->lhs->cty;
             break;
         } else if (x->rhs->cty->ty == K_MUL) {
-            x->lhs = new node(N_MUL, x->lhs, new node(N_NUM, x->rhs->cty->ptr_to->sz));
+            x->lhs = make<node>(N_MUL, x->lhs, make<node>(N_NUM, x->rhs->cty->ptr_to->sz));
             check_node(f, x->lhs);
             assert(is_int_type(x->lhs->cty), "Pointers addition is only compatible with int");
             x->cty = x->rhs->cty;
@@ -159,55 +154,50 @@ void check_node(func* f, node* x) {
         check_node(f, x->rhs);
         // Either numerical or pointer
         assert(is_int_type(x->lhs->cty) && is_int_type(x->rhs->cty) ||
-            *x->lhs->cty == *x->rhs->cty && x->lhs->cty->ty == K_MUL, "Incompatible types of equality test");
-        x->cty = new type(K_INT);
+            same_type(x->lhs->cty, x->rhs->cty) && x->lhs->cty->ty == K_MUL, "Incompatible types of equality test");
+        x->cty = type::int_t;
+        x->is_lval = false;
+        break;
+    case N_LAND:
+    case N_LOR:
+        check_node(f, x->lhs);
+        check_node(f, x->rhs);
+        assert(is_scalar(x->lhs->cty) && is_scalar(x->rhs->cty), "Logical operator on non-scalar");
+        x->cty = type::int_t;
+        x->is_lval = false;
+        break;
+    case N_NOT:
+        check_node(f, x->lhs);
+        assert(is_scalar(x->lhs->cty), "Logical operator on non-scalar");
+        x->cty = type::int_t;
         x->is_lval = false;
         break;
     case N_PLUSEQ:
     case N_MINUSEQ:
     case N_MULEQ:
     case N_DIVEQ:
-    case N_MODEQ: {
-        check_node(f, x->lhs);
-
-        var* v = new var;
-        v->ty = type::ptr(x->lhs->cty);
-        f->v->push(v);
-
-        node y(N_BLOCK);
-        y.nodes = {
-            new node(N_ASSIGN, new node(N_VARREF, v), new node(N_ADDR, x->lhs)),
-            new node(N_ASSIGN, new node(N_DEREF, new node(N_VARREF, v)), new node(ndmap[x->ty], new node(N_DEREF, new node(N_VARREF, v)), x->rhs))
-        };
-        y.cty = x->lhs->cty;
-        *x = y;
-        check_node(f, x);
-        break;
-    }
+    case N_MODEQ:
     case N_POSTINC:
-    case N_POSTDEC: {
+    case N_POSTDEC:
+        // The IR reads and writes the lvalue in place, so it is evaluated once
         check_node(f, x->lhs);
+        if (!x->rhs)
+            x->rhs = make<node>(N_NUM, 1);
+        check_node(f, x->rhs);
 
-        var* p = new var;
-        p->ty = type::ptr(x->lhs->cty);
-        f->v->push(p);
-
-        var* v = new var;
-        v->ty = x->lhs->cty;
-        f->v->push(v);
+        assert(x->lhs->is_lval, "Lvalue expected");
+        assert(!x->lhs->cty->is_const, "No assignment to const variable");
+        if (x->lhs->cty->ty == K_MUL) {
+            assert(x->ty != N_MULEQ && x->ty != N_DIVEQ && x->ty != N_MODEQ, "Incompatible types of binary operator");
+            assert(is_int_type(x->rhs->cty), "Pointers addition is only compatible with int");
+            x->rhs = make<node>(N_MUL, x->rhs, make<node>(N_NUM, x->lhs->cty->ptr_to->sz));
+            check_node(f, x->rhs);
+        } else
+            infer_type(x->lhs->cty, x->rhs->cty);
 
-        node y(N_BLOCK);
-        y.nodes = {
-            new node(N_ASSIGN, new node(N_VARREF, p), new node(N_ADDR, x->lhs)),
-            new node(N_ASSIGN, new node(N_VARREF, v), new node(N_DEREF, new node(N_VARREF, p))),
-            new node(ndmap[x->ty], new node(N_DEREF, new node(N_VARREF, p)), new node(N_NUM, 1)),
-            new node(N_VARREF, v)
-        };
-        y.cty = x->lhs->cty;
-        *x = y;
-        check_node(f, x);
+        x->cty = x->lhs->cty;
+        x->is_lval = false;
         break;
-    }
     case N_VARREF:
         x->cty = x->target->ty;
         x->is_lval = true;
@@ -226,24 +216,24 @@ void check_node(func* f, node* x) {
         x->is_lval = false;
         break;
     case N_BLOCK:
-        for (auto m : x->nodes)
+        for (auto m : *x->nodes)
             check_node(f, m);
         break;
     case N_FCALL: {
-        assert(fs[x->name].size(), "Function {} not found", x->name);
+        assert(fs[x->name].size(), "Function {} not found", name_of(x->name));
             
         const auto& fn = fs[x->name][0];
         const auto& fp = fn->params;
-        const auto& args = x->nodes;
+        const auto& args = *x->nodes;
 
         for (auto m : args)
             check_node(f, m);
 
-        assert(fn->is_variadic || fp.size() == args.size(), "Argument count doesn't match for {}", fn->name);
-        assert(fp.size() <= args.size(), "Function {} does not have enough arguments", fn->name);
+        assert(fn->is_variadic || fp.size() == args.size(), "Argument count doesn't match for {}", name_of(fn->name));
+        assert(fp.size() <= args.size(), "Function {} does not have enough arguments", name_of(fn->name));
         for (int i = 0; i < fp.size(); i++)
-            assert(fp[i]->ty == implicit(args[i]->cty), "Arguments #{} don't match for {}", i, fn->name);
-        x->val = args.size() - fp.size();
+            assert(fp[i]->ty == implicit(args[i]->cty), "Arguments #{} don't match for {}", i, name_of(fn->name));
+        x->callee = fn;
         x->is_lval = false;
         x->cty = fn->ret;
         break;
@@ -255,6 +245,25 @@ void check_node(func* f, node* x) {
         if (x->rhs)
             check_node(f, x->rhs);
         break;
+    case N_SWITCH: {
+        check_node(f, x->cond);
+        assert(is_int_type(x->cond->cty), "Switch on non-int");
+        check_node(f, x->lhs);
+
+        std::set<int> seen;
+        int defaults = 0;
+        for (auto c : *x->rhs->nodes)
+            if (c->ty == N_DEFAULT)
+                assert(++defaults == 1, "Multiple default labels");
+            else
+                assert(seen.insert(c->val).second, "Duplicate case {}", c->val);
+        break;
+    }
+    case N_CASE:
+    case N_DEFAULT:
+    case N_BREAK:
+    case N_CONTINUE:
+        break;
     case N_WHILE:
         check_node(f, x->cond);
         assert(is_int_type(x->cond->cty), "Condition is not int");
@@ -263,10 +272,8 @@ void check_node(func* f, node* x) {
     case N_FOR:
         check_node(f, x->cond);
         assert(is_int_type(x->cond->cty), "Condition is not int");
-        if (x->init)
-            check_node(f, x->init);
-        if (x->step)
-            check_node(f, x->step);
+        if (x->rhs)
+            check_node(f, x->rhs);
         check_node(f, x->lhs);
         break;
     default:
@@ -284,11 +291,11 @@ void check() {
         func* rep = vf[0];
         for (auto f : vf)
             if (!signature(f, rep))
-                throw new semantic_error(format("Overloading {}", name));
+                throw new semantic_error(format("Overloading {}", name_of(name)));
         
         int cnt = std::accumulate(vf.begin(), vf.end(), 0, [](int a, func* p) { return a + !!p->body; });
         if (cnt > 1)
-            throw new semantic_error(format("Multiple definition of {}", name));
+            throw new semantic_error(format("Multiple definition of {}", name_of(name)));
         
         if (cnt == 0)
             v.push_back(rep);
@@ -1,16 +1,114 @@
 #include "assem.h"
 #include "check.h"
+#include "opt.h"
+#include "regalloc.h"
+#include "ssa.h"
+#include "fmt/format.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <vector>
+#include <sys/resource.h>
 
-int main() {
-    for (std::string str; getline(std::cin, str); tin.tokenize(str));
+using fmt::format;
+
+// Prints time spent in each phase to stderr with -stats.
+bool show_stats = false;
+
+// Net change in instructions from each pass over all functions, in pipeline order, for -stats
+std::vector<std::pair<std::string, long>> changed;
+
+long size(cfg& bs) {
+    long n = 0;
+    for (auto b : bs)
+        n += b->irs.size();
+    return n;
+}
+
+template<class Pass>
+void run_pass(const char* name, cfg& bs, Pass pass) {
+    long before = size(bs);
+    pass(bs);
+    auto it = std::find_if(changed.begin(), changed.end(), [&](auto& p) { return p.first == name; });
+    if (it == changed.end())
+        it = changed.insert(it, std::make_pair(name, 0L));
+    it->second += size(bs) - before;
+}
+
+double elapsed(std::chrono::steady_clock::time_point& since) {
+    auto now = std::chrono::steady_clock::now();
+    double t = std::chrono::duration<double>(now - since).count();
+    since = now;
+    return t;
+}
+
+int main(int argc, char** argv) {
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-stats"))
+            show_stats = true;
+        else if (!strcmp(argv[i], "-O2"))
+            coloring = true;
+        else
+            path = argv[i];
+    }
+
+    auto clock = std::chrono::steady_clock::now();
+
+    // Input comes from the file given as argument, or from stdin
+    auto src = read_source(path);
+    double t_read = elapsed(clock);
+    tin.tokenize(src);
     tin.seteof();
+    double t_lex = elapsed(clock);
 
     parse();
+    double t_parse = elapsed(clock);
     check();
+    double t_check = elapsed(clock);
 
     auto ir = generate();
+    double t_gen = elapsed(clock);
+
+    for (auto& [f, bs] : ir) {
+        if (bs.empty())
+            continue;
+        run_pass("mem2reg", bs, [f = f](cfg& bs) { mem2reg(f, bs); });
+        run_pass("fold", bs, fold);
+        run_pass("gvn", bs, gvn);
+        run_pass("reduce", bs, reduce);
+        run_pass("address", bs, select_addresses);
+        run_pass("loads", bs, fold_loads);
+        run_pass("dce", bs, [f = f](cfg& bs) { dce(f, bs); });
+        leave_ssa(bs);
+    }
+    double t_opt = elapsed(clock);
 
     assemble(std::cout, ir);
+    double t_asm = elapsed(clock);
+
+    size_t arena_used = mem.used();
+    // Everything of the frontend dies with the translation unit
+    mem.release();
+
+    if (show_stats) {
+        std::cerr << format("read:  {:.3f}s, {} bytes\n", t_read, src.size())
+            << format("lex:   {:.3f}s, {} tokens, {:.0f} tokens/s\n", t_lex, tin.size(), tin.size() / t_lex)
+            << format("parse: {:.3f}s\n", t_parse)
+            << format("check: {:.3f}s\n", t_check)
+            << format("ir:    {:.3f}s\n", t_gen)
+            << format("opt:   {:.3f}s\n", t_opt);
+        for (auto& [name, n] : changed)
+            std::cerr << format("  {}: {:+} instructions\n", name, n);
+        std::cerr
+            << format("asm:   {:.3f}s\n", t_asm);
+
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        std::cerr << format("nodes: {}, {} bytes each\n", node::count, sizeof(node))
+            << format("arena: {} bytes\n", arena_used)
+            << format("peak RSS: {} KB\n", usage.ru_maxrss);
+    }
     return 0;
-}
\ No newline at end of file
+}
@@ -1,10 +1,8 @@
 #include "ir.h"
-#include "fmt/format.h"
+#include <algorithm>
 #include <map>
 #define MAPPED std::make_pair
 
-using fmt::format;
-
 std::map<node_type, ir_type> opmap {
     MAPPED(N_PLUS, I_ADD),
     MAPPED(N_MINUS, I_SUB),
@@ -17,36 +15,151 @@ std::map<node_type, ir_type> opmap {
     MAPPED(N_GEQ, I_GEQ),
     MAPPED(N_NEQ, I_NEQ),
     MAPPED(N_EQ, I_EQ),
+    MAPPED(N_PLUSEQ, I_ADD),
+    MAPPED(N_MINUSEQ, I_SUB),
+    MAPPED(N_MULEQ, I_IMUL),
+    MAPPED(N_DIVEQ, I_IDIV),
+    MAPPED(N_MODEQ, I_MOD),
+    MAPPED(N_POSTINC, I_ADD),
+    MAPPED(N_POSTDEC, I_SUB),
 };
 
 ir::ir(ir_type ty, int imm, reg* a0):
-    ty(ty), imm(imm), a0(a0), a1(nullptr) {}
+    ty(ty), a0(a0), a1(nullptr), a2(nullptr), imm(imm) {}
 
 ir::ir(ir_type ty, reg* a0, reg* a1):
-    ty(ty), a0(a0), a1(a1) {}
+    ty(ty), a0(a0), a1(a1), a2(nullptr) {}
 
 ir::ir(ir_type ty, reg* a0, var* v):
-    ty(ty), a0(a0), v(v), a1(nullptr) {}
+    ty(ty), a0(a0), a1(nullptr), a2(nullptr), v(v) {}
 
 ir::ir(ir_type ty, reg* a0, reg* a1, int sz):
-    ty(ty), a0(a0), a1(a1), sz(sz) {}
+    ty(ty), a0(a0), a1(a1), a2(nullptr), sz(sz) {}
 
-ir::ir(ir_type ty, std::string name, var* v):
-    ty(ty), name(name), v(v), a0(nullptr), a1(nullptr) {}
+ir::ir(ir_type ty, reg* a0, reg* a1, reg* a2):
+    ty(ty), a0(a0), a1(a1), a2(a2) {}
 
-ir::ir(std::string str):
-    ty(I_RAW), name(str), a0(nullptr), a1(nullptr) {}
+ir::ir(ir_type ty, reg* a0, block* to, block* els):
+    ty(ty), a0(a0), a1(nullptr), a2(nullptr), to(to), els(els) {}
 
 int reg::cnt = 0;
-reg::reg(): ind(cnt++), spilt(false), first(0), last(0), real(0) {}
+reg::reg(): ind(cnt++), real(0), spilt(false), dest(nullptr) {}
+
+block::block() {
+    static int cnt = 0;
+    id = cnt++;
+}
+
+bool is_terminator(ir* x) {
+    return x->ty == I_JMP || x->ty == I_BR || x->ty == I_RET || x->ty == I_SWITCH;
+}
+
+reg* def(ir* x) {
+    switch (x->ty) {
+    case I_STORE:
+    case I_RET:
+    case I_BR:
+    case I_JMP:
+    case I_SPILL_STORE:
+    case I_SWITCH:
+    case I_RMW:
+        return nullptr;
+    default:
+        return x->a0;
+    }
+}
 
+std::vector<reg*> uses(ir* x) {
+    std::vector<reg*> r;
+    switch (x->ty) {
+    case I_STORE:
+    case I_RET:
+    case I_BR:
+    case I_SPILL_STORE:
+    case I_SWITCH:
+        if (x->a0)
+            r.push_back(x->a0);
+        break;
+    default:
+        break;
+    }
+    if (x->a1)
+        r.push_back(x->a1);
+    if (x->a2)
+        r.push_back(x->a2);
+    for (auto p : x->params)
+        r.push_back(p);
+    if (x->mem)
+        for (auto p : uses(x->mem))
+            r.push_back(p);
+    return r;
+}
+
+void replace_use(ir* x, reg* from, reg* to) {
+    if (x->a0 == from && !def(x))
+        x->a0 = to;
+    if (x->a1 == from)
+        x->a1 = to;
+    if (x->a2 == from)
+        x->a2 = to;
+    for (auto& p : x->params)
+        if (p == from)
+            p = to;
+    if (x->mem)
+        replace_use(x->mem, from, to);
+}
+
+void link(cfg& bs) {
+    for (auto b : bs) {
+        b->succs.clear();
+        b->preds.clear();
+    }
+    for (auto b : bs) {
+        ir* t = b->terminator();
+        if (t->ty == I_JMP)
+            b->succs = { t->to };
+        if (t->ty == I_BR)
+            b->succs = t->to == t->els ? std::vector<block*> { t->to } : std::vector<block*> { t->to, t->els };
+        if (t->ty == I_SWITCH) {
+            t->table.push_back(t->els);
+            for (auto s : t->table)
+                if (std::find(b->succs.begin(), b->succs.end(), s) == b->succs.end())
+                    b->succs.push_back(s);
+            t->table.pop_back();
+        }
+        for (auto s : b->succs)
+            s->preds.push_back(b);
+    }
+}
 
 // The result of generate()
-std::vector<ir*> res;
+cfg res;
+// The block we are appending to
+block* curr;
+// Where break and continue go, the innermost last.
+// Switches push to breaks only.
+std::vector<block*> breaks;
+std::vector<block*> continues;
+// Blocks of case and default labels
+std::map<node*, block*> labels;
 
 template<class... T>
 void push(T... args) {
-    res.push_back(new ir(args...));
+    curr->irs.push_back(new ir(args...));
+}
+
+// Starts appending to b, placing it after all blocks so far.
+void enter(block* b) {
+    res.push_back(b);
+    curr = b;
+}
+
+// Ends the current block with a terminator.
+// The code after it goes to a new block, which is unreachable unless jumped to.
+template<class... T>
+void terminate(T... args) {
+    push(args...);
+    enter(new block);
 }
 
 reg* gen_imm(node* x) {
@@ -72,13 +185,107 @@ reg* gen_addr(node* x) {
     return a0;
 }
 
+// Ends the current block, going to `to` if cond holds and to `els` otherwise.
+// A comparison decides the branch by itself, without its value in a register,
+// and logical operators become chains of such branches.
+void gen_branch(node* cond, block* to, block* els) {
+    block* next;
+    switch (cond->ty) {
+    case N_LAND:
+        next = new block;
+        gen_branch(cond->lhs, next, els);
+        enter(next);
+        gen_branch(cond->rhs, to, els);
+        return;
+    case N_LOR:
+        next = new block;
+        gen_branch(cond->lhs, to, next);
+        enter(next);
+        gen_branch(cond->rhs, to, els);
+        return;
+    case N_NOT:
+        gen_branch(cond->lhs, els, to);
+        return;
+    case N_EQ:
+    case N_LEQ:
+    case N_GEQ:
+    case N_NEQ:
+    case N_GE:
+    case N_LE: {
+        reg* a1 = gen_expr(cond->lhs);
+        reg* a2 = gen_expr(cond->rhs);
+        ir* br = new ir(I_BR, nullptr, to, els);
+        br->a1 = a1;
+        br->a2 = a2;
+        br->cmp = opmap[cond->ty];
+        curr->irs.push_back(br);
+        return;
+    }
+    default:
+        push(I_BR, gen_expr(cond), to, els);
+    }
+}
+
+// Ends the current block, going to the case of sel among cases[lo, hi), or dflt if none.
+// Cases are sorted by value. Dense ones take a jump table, and the rest a binary search.
+void gen_switch(reg* sel, std::vector<std::pair<int, block*>>& cases, int lo, int hi, block* dflt) {
+    auto compare = [&](ir_type cmp, int val, block* to, block* els) {
+        reg* a2 = new reg;
+        push(I_IMM, val, a2);
+        ir* br = new ir(I_BR, nullptr, to, els);
+        br->a1 = sel;
+        br->a2 = a2;
+        br->cmp = cmp;
+        curr->irs.push_back(br);
+    };
+
+    int n = hi - lo;
+    if (n == 0) {
+        push(I_JMP, nullptr, dflt);
+        return;
+    }
+
+    long first = cases[lo].first, last = cases[hi - 1].first;
+    if (n >= 4 && last - first < 3L * n) {
+        // The table is indexed from 0, so no displacement has to fit in 32 bits
+        reg* index = sel;
+        if (first) {
+            reg* base = new reg;
+            index = new reg;
+            push(I_IMM, first, base);
+            push(I_SUB, index, sel, base);
+        }
+        ir* sw = new ir(I_SWITCH, index, dflt, dflt);
+        sw->table.assign(last - first + 1, dflt);
+        for (int i = lo; i < hi; i++)
+            sw->table[cases[i].first - first] = cases[i].second;
+        curr->irs.push_back(sw);
+        return;
+    }
+
+    if (n <= 3) {
+        for (int i = lo; i < hi; i++) {
+            block* next = i + 1 < hi ? new block : dflt;
+            compare(I_EQ, cases[i].first, cases[i].second, next);
+            if (next != dflt)
+                enter(next);
+        }
+        return;
+    }
+
+    int mid = (lo + hi) / 2;
+    block* left = new block;
+    block* right = new block;
+    compare(I_LE, cases[mid].first, left, right);
+    enter(left);
+    gen_switch(sel, cases, lo, mid, dflt);
+    enter(right);
+    gen_switch(sel, cases, mid, hi, dflt);
+}
+
 reg* gen_expr(node* x) {
     reg *a0 = nullptr, *a1, *a2;
 
-    static int if_cnt = 0;
-    static int while_cnt = 0;
-    static int for_cnt = 0;
-
     switch (x->ty) {
     case N_NUM:
         return gen_imm(x);
@@ -86,7 +293,7 @@ reg* gen_expr(node* x) {
         if (x->lhs)
             a0 = gen_expr(x->lhs);
 
-        push(I_RET, a0);
+        terminate(I_RET, a0);
         return a0;
     case N_PLUS:
     case N_MINUS:
@@ -99,11 +306,46 @@ reg* gen_expr(node* x) {
     case N_NEQ:
     case N_GE:
     case N_LE:
-        a0 = gen_expr(x->lhs);
-        a1 = gen_expr(x->rhs);
+        a1 = gen_expr(x->lhs);
+        a2 = gen_expr(x->rhs);
+        a0 = new reg;
         
-        push(opmap[x->ty], a0, a1);
+        push(opmap[x->ty], a0, a1, a2);
         return a0;
+    case N_NOT:
+        a1 = gen_expr(x->lhs);
+        a2 = new reg;
+        a0 = new reg;
+
+        push(I_IMM, 0, a2);
+        push(I_EQ, a0, a1, a2);
+        return a0;
+    case N_LAND:
+    case N_LOR: {
+        // Both outcomes meet at a phi of 1 and 0
+        block* yes = new block;
+        block* no = new block;
+        block* end = new block;
+        gen_branch(x, yes, no);
+
+        enter(yes);
+        a1 = new reg;
+        push(I_IMM, 1, a1);
+        push(I_JMP, nullptr, end);
+
+        enter(no);
+        a2 = new reg;
+        push(I_IMM, 0, a2);
+        push(I_JMP, nullptr, end);
+
+        enter(end);
+        a0 = new reg;
+        ir* phi = new ir(I_PHI, a0);
+        phi->params = { a1, a2 };
+        phi->from = { yes, no };
+        curr->irs.push_back(phi);
+        return a0;
+    }
     case N_VARREF:
         a0 = new reg;
         a1 = gen_addr(x);
@@ -126,8 +368,25 @@ reg* gen_expr(node* x) {
 
         push(I_STORE, a0, a1, x->cty->sz);
         return a1; // !! We need value rather than address
+    case N_PLUSEQ:
+    case N_MINUSEQ:
+    case N_MULEQ:
+    case N_DIVEQ:
+    case N_MODEQ:
+    case N_POSTINC:
+    case N_POSTDEC: {
+        // Read, modify and write back the lvalue, computing its address once
+        reg* addr = gen_addr(x->lhs);
+        a1 = new reg;
+        push(I_LOAD, a1, addr, x->cty->sz);
+        a2 = gen_expr(x->rhs);
+        a0 = new reg;
+        push(opmap[x->ty], a0, a1, a2);
+        push(I_STORE, addr, a0, x->cty->sz);
+        return x->ty == N_POSTINC || x->ty == N_POSTDEC ? a1 : a0;
+    }
     case N_BLOCK:      
-        for (auto m : x->nodes)
+        for (auto m : *x->nodes)
             a0 = gen_expr(m);
 
         return a0;
@@ -135,58 +394,98 @@ reg* gen_expr(node* x) {
         a0 = new reg;
 
         ir* i = new ir(I_CALL, a0);
-        for (auto m : x->nodes)
+        for (auto m : *x->nodes)
             i->params.push_back(gen_expr(m));
-        i->name = x->name;
-        i->imm = x->val;
-        res.push_back(i);
+        i->name = name_of(x->name);
+        // Amount of excessive arguments for a variadic function
+        i->imm = x->nodes->size() - x->callee->params.size();
+        curr->irs.push_back(i);
         return a0;
     }
     case N_IF: {
-        // Record current count
-        // in case x->lhs contains another if clause
-        int my_cnt = if_cnt++;
-        a0 = gen_expr(x->cond);
-        push(I_IF, my_cnt, a0);
+        block* then = new block;
+        block* els = x->rhs ? new block : nullptr;
+        block* end = new block;
 
+        gen_branch(x->cond, then, els ? els : end);
+
+        enter(then);
         gen_expr(x->lhs);
+        push(I_JMP, nullptr, end);
 
-        if (x->rhs) {
-            push(format("jmp .Lif_{}_end", my_cnt));
-            push(format(".Lif_{}_unhit:", my_cnt));
+        if (els) {
+            enter(els);
             gen_expr(x->rhs);
-            push(format(".Lif_{}_end:", my_cnt));
-        } else {
-            push(format(".Lif_{}_unhit:", my_cnt));
+            push(I_JMP, nullptr, end);
         }
+        enter(end);
         return a0;
     }
-    case N_WHILE: {
-        int my_cnt = while_cnt++;
+    case N_SWITCH: {
+        block* end = new block;
+        block* dflt = end;
+        std::vector<std::pair<int, block*>> cases;
+        for (auto c : *x->rhs->nodes) {
+            block* b = labels[c] = new block;
+            if (c->ty == N_DEFAULT)
+                dflt = b;
+            else
+                cases.push_back({ c->val, b });
+        }
+        std::sort(cases.begin(), cases.end());
 
-        push(format(".Lwhile_{}_begin:", my_cnt));
         a0 = gen_expr(x->cond);
-        push(I_WHILE, my_cnt, a0);
+        gen_switch(a0, cases, 0, cases.size(), dflt);
+        // Code before the first label is unreachable
+        enter(new block);
+
+        breaks.push_back(end);
         gen_expr(x->lhs);
-        push(format("jmp .Lwhile_{}_begin", my_cnt));
-        push(format(".Lwhile_{}_end:", my_cnt));
-        
-        return a0;
+        breaks.pop_back();
+        push(I_JMP, nullptr, end);
+
+        enter(end);
+        return nullptr;
     }
+    case N_CASE:
+    case N_DEFAULT:
+        // Falls through from the code before
+        push(I_JMP, nullptr, labels[x]);
+        enter(labels[x]);
+        return nullptr;
+    case N_BREAK:
+        terminate(I_JMP, nullptr, breaks.back());
+        return nullptr;
+    case N_CONTINUE:
+        terminate(I_JMP, nullptr, continues.back());
+        return nullptr;
+    case N_WHILE:
     case N_FOR: {
-        int my_cnt = for_cnt++;
+        block* cond = new block;
+        block* body = new block;
+        // Step expression of for, where continue goes
+        block* step = x->rhs ? new block : cond;
+        block* end = new block;
+
+        push(I_JMP, nullptr, cond);
+        enter(cond);
+        gen_branch(x->cond, body, end);
+
+        enter(body);
+        breaks.push_back(end);
+        continues.push_back(step);
+        gen_expr(x->lhs);
+        breaks.pop_back();
+        continues.pop_back();
+        push(I_JMP, nullptr, step);
 
-        if (x->init)
-            gen_expr(x->init);
+        if (x->rhs) {
+            enter(step);
+            gen_expr(x->rhs);
+            push(I_JMP, nullptr, cond);
+        }
 
-        push(format(".Lfor_{}_begin:", my_cnt));
-        a0 = gen_expr(x->cond);
-        push(I_FOR, my_cnt, a0);
-        gen_expr(x->lhs);
-        if (x->step)
-            gen_expr(x->step);
-        push(format("jmp .Lfor_{}_begin", my_cnt));
-        push(format(".Lfor_{}_end:", my_cnt));
+        enter(end);
         return a0;
     }
     default:
@@ -194,14 +493,35 @@ reg* gen_expr(node* x) {
     }
 }
 
-std::map<func*, std::vector<ir*>> generate() {
+std::vector<std::pair<func*, cfg>> generate() {
     decltype(generate()) p;
     for (auto f : funcs) {
         res.clear();
-        if (f->body)
+        if (f->body) {
+            enter(new block);
+
+            // Copy arguments passed by register to their stack slots.
+            // Reading all of them comes first, before anything else may clobber them.
+            int n = std::min<int>(6, f->params.size());
+            std::vector<reg*> args;
+            for (int i = 0; i < n; i++) {
+                args.push_back(new reg);
+                push(I_ARG, i, args[i]);
+            }
+            for (int i = 0; i < n; i++) {
+                var* v = f->params[i];
+                reg* a = new reg;
+                push(I_LOCALREF, a, v);
+                push(I_STORE, a, args[i], v->ty->sz);
+            }
+
             gen_expr(f->body);
-        p[f] = res;
+            // Falling off the end of function
+            push(I_RET, nullptr);
+            link(res);
+        }
+        p.emplace_back(f, res);
     }
     
     return p;
-}
\ No newline at end of file
+}
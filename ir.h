@@ -2,6 +2,10 @@
 #include "ast.h"
 #include <map>
 
+// Instructions are in three-address form:
+// a0 is the result, while a1 and a2 are operands.
+// Arithmetic, comparisons and I_BR without a2 take imm as the second operand.
+// Every register is defined once until the IR leaves SSA form.
 enum ir_type {
     I_IMM,          // immediate value
     I_ADD,          // add
@@ -9,24 +13,33 @@ enum ir_type {
     I_IMUL,         // imul
     I_IDIV,         // cqo; idiv; rax
     I_MOD,          // cqo; idiv; rdx
-    I_RET,          // mov rax, {}; jmp
-    I_STORE,        // mov [{}], ...
+    I_RET,          // mov rax, {}; jmp; terminator
+    I_STORE,        // mov [{}], ...; a0 is the address, a1 the value
     I_LOCALREF,     // lea {}, [rbp-offset];
     I_GLOBALREF,    // lea {}, VARNAME;
     I_LOAD,         // mov {}, [...]
     I_CALL,         // call
-    I_IF,           // cmp {}, 0; jne
-    I_WHILE,        // cmp {}, 0; jne
-    I_FOR,          // cmp {}, 0; jne
+    I_JMP,          // jmp; terminator
+    I_BR,           // cmp {}, 0; jne; jmp; terminator; or cmp a1, a2; jcc
     I_GE,           // setg
     I_LE,           // setl
     I_LEQ,          // setle
     I_GEQ,          // setge
     I_NEQ,          // setne
     I_EQ,           // sete
-    I_RAW,          // (raw assembly)
-    I_SPILL_LOAD,   // mov {}, [...]
-    I_SPILL_STORE,  // mov [{}], ...
+    I_MOV,          // mov
+    I_SEXT,         // movsx; sign-extends the lowest sz bytes
+    I_ARG,          // mov {}, rdi (etc); reads the imm-th argument
+    I_PHI,          // SSA phi; params[i] comes from block from[i]
+    I_SPILL_LOAD,   // mov {}, [rbp-offset]
+    I_SPILL_STORE,  // mov [rbp-offset], {}
+    I_SWITCH,       // jmp [table + {}*8]; terminator
+    I_SHL,          // shl {}, imm
+    I_SAR,          // sar {}, imm
+    I_SHR,          // shr {}, imm
+    I_MULHI,        // mov rax, imm; imul; rdx; high half of the signed product
+    I_LEA,          // lea {}, [a1 + a2*scale + imm]
+    I_RMW,          // add [mem], a1; op of the memory that mem loads, and a1 or imm
 };
 
 // Note: register is a keyword
@@ -37,44 +50,105 @@ public:
     // (virtual) index of the register
     int ind;
 
-    // These properties are used when tidying registers.
+    // These properties are filled by register allocation.
 
     // real index of the register
     int real;
-    // the last place where the register is used
-    int last;
-    // the first place where the register comes into existence
-    int first;
 
-    // for spilling
+    // for spilling: the value lives in the stack slot dest
     bool spilt;
     var* dest;
 
     reg();
 };
 
+struct block;
+
 struct ir {
     ir_type ty;
-    // operands of the instruction
-    reg *a0, *a1;
+    // result and operands of the instruction
+    reg *a0, *a1, *a2;
     // for I_IMM, immediate value
-    // for I_JMP, the number of label
-    int imm;
+    // for I_ARG, index of the argument
+    // for shifts, the amount to shift by
+    // for I_LOAD and I_STORE, added to the address
+    long imm = 0;
+    // for I_LEA, I_LOAD and I_STORE, what a2 is multiplied by
+    int scale = 1;
     // variable involved
-    var* v;
-    // size of LOAD/STORE
-    int sz;
-    // parameters of function call
+    // for I_LOAD and I_STORE, the address is v + a2*scale + imm if v is given,
+    // where v is a local or global; otherwise the address register + a2*scale + imm
+    var* v = nullptr;
+    // size of LOAD/STORE/SEXT
+    int sz = 0;
+    // parameters of function call; incoming values of phi
     std::vector<reg*> params;
     // name of function call
     std::string name;
+    // for I_JMP, the target
+    // for I_SWITCH, goes to table[a0] if a0 is within, otherwise to `els`
+    // for I_BR, goes to `to` if a0 is non-zero, otherwise to `els`.
+    // Without a0, goes to `to` if the comparison cmp of a1 and a2 holds.
+    block* to = nullptr;
+    block* els = nullptr;
+    ir_type cmp;
+    // for I_PHI, where each of params comes from
+    std::vector<block*> from;
+    // for I_SWITCH, the jump table
+    std::vector<block*> table;
+    // for arithmetic, comparisons and I_BR, a load read straight from memory:
+    // in place of a1 if there is none, compared to imm; otherwise in place of a2
+    // for I_RMW, the load of the memory written
+    ir* mem = nullptr;
+    // for I_RMW, I_ADD or I_SUB
+    ir_type op;
+    // for I_CALL, caller-saved real registers live across it, as a bit mask;
+    // filled by register allocation
+    int saved = 0;
 
     ir(ir_type ty, int imm, reg* a0);
     ir(ir_type ty, reg* a0=nullptr, reg* a1=nullptr);
     ir(ir_type ty, reg* a0, var* v);
     ir(ir_type ty, reg* a0, reg* a1, int sz);
-    ir(ir_type ty, std::string name, var* v);
-    ir(std::string);
+    ir(ir_type ty, reg* a0, reg* a1, reg* a2);
+    ir(ir_type ty, reg* a0, block* to, block* els=nullptr);
 };
 
-std::map<func*, std::vector<ir*>> generate();
\ No newline at end of file
+// A basic block: straight-line code ending with a terminator,
+// which is the only instruction that leaves the block.
+// Phis, if any, come first.
+struct block {
+    // Used as label
+    int id;
+    std::vector<ir*> irs;
+
+    std::vector<block*> succs;
+    std::vector<block*> preds;
+
+    // Dominator tree; filled by dominators()
+    block* idom;
+    std::vector<block*> doms;
+    std::vector<block*> frontier;
+
+    block();
+
+    ir* terminator() { return irs.back(); }
+};
+
+// Control flow graph of a function.
+// Blocks are in layout order, and the first one is the entry.
+using cfg = std::vector<block*>;
+
+bool is_terminator(ir*);
+
+// The register an instruction defines, if any.
+reg* def(ir*);
+// Registers an instruction reads.
+std::vector<reg*> uses(ir*);
+// Replaces every read of `from` by `to`.
+void replace_use(ir*, reg* from, reg* to);
+
+// Recomputes succs and preds of all blocks from their terminators.
+void link(cfg&);
+
+std::vector<std::pair<func*, cfg>> generate();
@@ -2,52 +2,103 @@
 #include "fmt/format.h"
 #include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <deque>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #define MAPPED std::make_pair
 
 tstream tin;
 
-std::map<std::string, token_type> tkmap {
-    MAPPED("return", K_RET),
-    MAPPED("if", K_IF),
-    MAPPED("else", K_ELSE),
-    MAPPED("for", K_FOR),
-    MAPPED("while", K_WHILE),
-    MAPPED("int", K_INT),
-    MAPPED("long", K_LONG),
-    MAPPED("short", K_SHORT),
-    MAPPED("char", K_CHAR),
-    MAPPED("void", K_VOID),
-    MAPPED("+", K_PLUS),
-    MAPPED("-", K_MINUS),
-    MAPPED("*", K_MUL),
-    MAPPED("/", K_DIV),
-    MAPPED("%", K_MOD),
-    MAPPED(";", K_SEMICOLON),
-    MAPPED("(", K_LPARENS),
-    MAPPED(")", K_RPARENS),
-    MAPPED("{", K_LBRACE),
-    MAPPED("}", K_RBRACE),
-    MAPPED(",", K_COMMA),
-    MAPPED("=", K_ASSIGN),
-    MAPPED("<", K_LE),
-    MAPPED("<=", K_LEQ),
-    MAPPED(">", K_GE),
-    MAPPED(">=", K_GEQ),
-    MAPPED("==", K_EQ),
-    MAPPED("!=", K_NEQ),
-    MAPPED("+=", K_PLUSEQ),
-    MAPPED("-=", K_MINUSEQ),
-    MAPPED("*=", K_MULEQ),
-    MAPPED("/=", K_DIVEQ),
-    MAPPED("%=", K_MODEQ),
-    MAPPED("++", K_PP),
-    MAPPED("--", K_MM),
-    MAPPED("&", K_AND),
-    MAPPED("[", K_LBRACKET),
-    MAPPED("]", K_RBRACKET),
-    MAPPED("const", K_CONST),
-};
+// Recognises keywords by switching on length, then on characters.
+// Returns K_IDENT if str is not a keyword.
+token_type keyword(std::string_view str) {
+    switch (str.size()) {
+    case 2:
+        if (str == "if") return K_IF;
+        break;
+    case 3:
+        if (str == "int") return K_INT;
+        if (str == "for") return K_FOR;
+        break;
+    case 4:
+        switch (str[0]) {
+        case 'e': if (str == "else") return K_ELSE; break;
+        case 'l': if (str == "long") return K_LONG; break;
+        case 'c':
+            if (str == "char") return K_CHAR;
+            if (str == "case") return K_CASE;
+            break;
+        case 'v': if (str == "void") return K_VOID; break;
+        }
+        break;
+    case 5:
+        switch (str[0]) {
+        case 'w': if (str == "while") return K_WHILE; break;
+        case 's': if (str == "short") return K_SHORT; break;
+        case 'c': if (str == "const") return K_CONST; break;
+        case 'b': if (str == "break") return K_BREAK; break;
+        }
+        break;
+    case 6:
+        if (str == "return") return K_RET;
+        if (str == "switch") return K_SWITCH;
+        break;
+    case 7:
+        if (str == "default") return K_DEFAULT;
+        break;
+    case 8:
+        if (str == "continue") return K_CONTINUE;
+        break;
+    }
+    return K_IDENT;
+}
+
+// Recognises the operator at the start of str by switching on its first
+// character, trying the longer spelling first (maximal munch).
+// Sets len to its length; returns K_EOF if str does not start with an operator.
+token_type punct(std::string_view str, int& len) {
+    char next = str.size() > 1 ? str[1] : 0;
+    len = 2;
+    switch (str[0]) {
+    case '+':
+        if (next == '+') return K_PP;
+        if (next == '=') return K_PLUSEQ;
+        len = 1; return K_PLUS;
+    case '-':
+        if (next == '-') return K_MM;
+        if (next == '=') return K_MINUSEQ;
+        len = 1; return K_MINUS;
+    case '*': if (next == '=') return K_MULEQ; len = 1; return K_MUL;
+    case '/': if (next == '=') return K_DIVEQ; len = 1; return K_DIV;
+    case '%': if (next == '=') return K_MODEQ; len = 1; return K_MOD;
+    case '<': if (next == '=') return K_LEQ; len = 1; return K_LE;
+    case '>': if (next == '=') return K_GEQ; len = 1; return K_GE;
+    case '=': if (next == '=') return K_EQ; len = 1; return K_ASSIGN;
+    case '!': if (next == '=') return K_NEQ; len = 1; return K_NOT;
+    case '&': if (next == '&') return K_LAND; len = 1; return K_AND;
+    case '|': if (next == '|') return K_LOR; break;
+    case '.': if (str.substr(0, 3) == "...") { len = 3; return K_DOTS; } break;
+    }
+    len = 1;
+    switch (str[0]) {
+    case ';': return K_SEMICOLON;
+    case '(': return K_LPARENS;
+    case ')': return K_RPARENS;
+    case '{': return K_LBRACE;
+    case '}': return K_RBRACE;
+    case '[': return K_LBRACKET;
+    case ']': return K_RBRACKET;
+    case ',': return K_COMMA;
+    case ':': return K_COLON;
+    }
+    len = 0;
+    return K_EOF;
+}
 
 std::map<char, char> escape {
     MAPPED('n', '\n'),
@@ -63,7 +114,23 @@ std::map<char, char> escape {
     MAPPED('\"', '\"'),
 };
 
-bool is_in_comment = false;
+// Strings of all symbols; a deque never moves its elements,
+// so the keys of syms can safely view into it.
+std::deque<std::string> names { "" };
+std::unordered_map<std::string_view, symbol> syms { { names[0], 0 } };
+
+symbol intern(std::string_view str) {
+    auto it = syms.find(str);
+    if (it != syms.end())
+        return it->second;
+
+    names.emplace_back(str);
+    return syms[names.back()] = names.size() - 1;
+}
+
+const std::string& name_of(symbol x) {
+    return names[x];
+}
 
 // hexadecimal
 int hex(char x) {
@@ -95,145 +162,186 @@ int bin(char x) {
 
 // Process an escape sequence and return a char.
 // Moves i to the next character.
-char escaped(const std::string& what, int& i) {
-    if (what[i] != '\\')
-        return what[i++];
+char escaped(std::string_view what, int& i) {
+    // The literal may be cut off by the end of input; reading past it gives '\0'.
+    const int n = what.size();
+    auto at = [&](int i) { return i < n ? what[i] : '\0'; };
+    if (at(i) != '\\')
+        return at(i++);
     
     ++i;
     // hexadecmial
-    if (what[i] == 'x') {
-        if (i + 2 >= what.size() - 1)
+    if (at(i) == 'x') {
+        if (i + 2 >= n)
             throw unexpected_token("Escape sequence not finished");
-        int x = hex(what[i + 1]) * 16 + hex(what[i + 2]);
+        int x = hex(at(i + 1)) * 16 + hex(at(i + 2));
         
         i += 3;
         return x;
     }
     // octal
-    if (isdigit(what[i])) {
-        if (i + 2 >= what.size() - 1)
-            throw unexpected_token("Escape sequence not finished");
+    if (isdigit(at(i))) {
         // Pay special attention to \0
-        if (what[i] == '0' && !(what[i + 1] >= '0' && what[i + 1] <= '7')) {
+        if (at(i) == '0' && !(at(i + 1) >= '0' && at(i + 1) <= '7')) {
             i++;
             return '\0';
         }
-        int x = oct(what[i]) * 64 + oct(what[i + 1]) * 8 + oct(what[i + 2]);
+        if (i + 2 >= n)
+            throw unexpected_token("Escape sequence not finished");
+        int x = oct(at(i)) * 64 + oct(at(i + 1)) * 8 + oct(at(i + 2));
         i += 3;
         return x;
     }
     // normal
-    if (escape.find(what[i]) != escape.end()) {
-        return escape[what[i++]];
+    if (escape.find(at(i)) != escape.end()) {
+        return escape[at(i++)];
     }
 
     throw unexpected_token("Bad escape sequence");
 }
 
-void tstream::tokenize(std::string what) {
-    static std::string ext[] = {
-        "+", "-", "<", ">", "=", "*", "/", "%", "!"
-    };
-    // Because we need to regularly access what[i + 1]
-    // So we add an \0 to the end in order to prevent out-of-range access
-    what.push_back('\0');
-    for (int i = 0; i < what.size() - 1;) {
-        if (is_in_comment) {
-            if (what[i] == '*' && what[i + 1] == '/') {
-                is_in_comment = false;
-                i += 2;
-            } else i++;
-            continue;
-        }
+std::string_view read_source(const char* path) {
+    if (!path) {
+        // stdin can't be mapped in general (eg. pipes), so read it in bulk
+        static std::string buf(std::istreambuf_iterator<char>(std::cin), {});
+        return buf;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        throw unexpected_token(std::string("Cannot open ") + path);
 
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw unexpected_token(std::string("Cannot stat ") + path);
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return "";
+    }
+
+    // The mapping lives until the process exits, since tokens refer to it.
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        throw unexpected_token(std::string("Cannot map ") + path);
+
+    return std::string_view((const char*) p, st.st_size);
+}
+
+void tstream::push(token_type ty, int val, int offset, int len) {
+    kinds.push_back(ty);
+    vals.push_back(val);
+    offsets.push_back(offset);
+    lens.push_back(len);
+}
+
+void tstream::tokenize(std::string_view what) {
+
+    const int n = what.size();
+    // We regularly access what[i + 1], so reading past the end gives '\0'.
+    auto at = [&](int i) { return i < n ? what[i] : '\0'; };
+    src = what;
+
+    // A token is rarely shorter than 2 characters with its spacing,
+    // so this avoids most reallocation
+    kinds.reserve(n / 2);
+    vals.reserve(n / 2);
+    offsets.reserve(n / 2);
+    lens.reserve(n / 2);
+
+    for (int i = 0; i < n;) {
         char x = what[i];
+        int begin = i;
 
-        if (isblank(x)) {
+        if (isspace(x)) {
             i++;
             continue;
         }
 
         // Reads an identifier - or a keyword.
         if (isalpha(x)) {
-            std::string str;
-            while (isalpha(what[i]))
-                str.push_back(what[i++]);
+            while (isalpha(at(i)))
+                i++;
             
-            if (tkmap.find(str) != tkmap.end())
-                tokens.push_back({ tkmap[str] });
-            else {
-                token t { K_IDENT };
-                t.ident = str;
-                tokens.push_back(t);
-            }
+            auto str = what.substr(begin, i - begin);
+            token_type ty = keyword(str);
+            push(ty, ty == K_IDENT ? intern(str) : 0, begin, i - begin);
             continue;
         }
 
         // Reads a number.
         if (isdigit(x)) {
             int val = 0;
-            while (isdigit(what[i]))
+            while (isdigit(at(i)))
                 val = 10 * val + what[i++] - '0';
-            tokens.push_back({ K_NUM, val });
+            push(K_NUM, val, begin, i - begin);
             continue;
         }
 
         // Reads an char literal, i.e. a number.
-        if (what[i] == '\'') {
-            tokens.push_back({ K_NUM, escaped(what, ++i) });
-            if (what[i++] != '\'')
+        if (x == '\'') {
+            if (++i >= n)
+                throw unexpected_token("Char literal not properly closed");
+            int val = escaped(what, i);
+            if (at(i++) != '\'')
                 throw unexpected_token("Char literal not properly closed");
+            push(K_NUM, val, begin, i - begin);
             
             continue;
         }
 
         // Reads a char[] literal.
-        if (what[i] == '"') {
+        if (x == '"') {
             std::string s;
             i++;
-            while (what[i] != '"' && what[i] != '\0') {
+            while (at(i) != '"' && at(i) != '\n' && at(i) != '\0') {
                 s += escaped(what, i);
             }
-            if (what[i++] != '"')
+            if (at(i++) != '"')
                 throw unexpected_token("String literal not properly closed");
-            token t = { K_STR };
-            t.ident = s;
-            tokens.push_back(t);
+            push(K_STR, intern(s), begin, i - begin);
             continue;
         }
 
-        // Reads an operator.
-        std::string s = std::string() + x;
-        if (what[i + 1] == '=' && std::find(ext, ext + sizeof(ext), s) != ext + sizeof(ext))
-            s += what[++i];
-        if (what[i] == '+' && what[i + 1] == '+' || what[i] == '-' && what[i + 1] == '-')
-            s += what[++i];
-        if (what[i] == '.' && what[i + 1] == '.' && i + 2 < what.size() && what[i + 2] == '.') {
-            tokens.push_back({ K_DOTS });
-            i += 3;
+        // Skips comments.
+        if (x == '/' && at(i + 1) == '/') {
+            while (i < n && what[i] != '\n')
+                i++;
             continue;
         }
-
-        // tokenize() only deals with a single line.
-        if (what[i] == '/' && what[i + 1] == '/')
-            return;
-        if (what[i] == '/' && what[i + 1] == '*') {
-            is_in_comment = true;
+        if (x == '/' && at(i + 1) == '*') {
+            bool is_in_comment = true;
+            for (i += 2; i < n && is_in_comment;) {
+                if (what[i] == '*' && at(i + 1) == '/') {
+                    is_in_comment = false;
+                    i += 2;
+                } else i++;
+            }
+            if (is_in_comment)
+                throw unexpected_token("Comment not properly closed");
             continue;
         }
-            
-        tokens.push_back({ tkmap[s] });
-        i++;
+
+        // Reads an operator.
+        int len;
+        token_type ty = punct(what.substr(i), len);
+        if (!len)
+            throw unexpected_token(std::string("Unknown character ") + x);
+        push(ty, 0, i, len);
+        i += len;
     }
 }
 
 void expect(token_type t) {
-    if (tin.consume().ty != t)
-        throw unexpected_token(std::string("Expected ") + std::to_string((int) t));
+    int x = tin.consume();
+    if (tin.kind(x) != t)
+        throw unexpected_token(fmt::format("Expected {} before '{}'", (int) t, tin.text(x)));
 }
 
 bool test(token_type t) {
-    if (tin.peek().ty == t) {
+    if (tin.peek() == t) {
         tin.consume();
         return true;
     }
@@ -1,8 +1,9 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 
-enum token_type {
+enum token_type: unsigned char {
     K_NUM,          // number literal
     K_PLUS,         // +
     K_MINUS,        // -
@@ -47,16 +48,24 @@ enum token_type {
     K_CONST,        // const
     K_STR,          // "a string"
     K_DOTS,         // ...
+    K_LAND,         // &&
+    K_LOR,          // ||
+    K_NOT,          // !
+    K_SWITCH,       // switch
+    K_CASE,         // case
+    K_DEFAULT,      // default
+    K_BREAK,        // break
+    K_CONTINUE,     // continue
+    K_COLON,        // :
 };
 
-struct token {
-    token_type ty;
-    int val;
+// An interned string.
+// Equal strings share one symbol, so names compare as integers.
+// The empty string is always symbol 0.
+using symbol = int;
 
-    // For K_IDENT, this is identifier
-    // For K_STR, this is the content of the string literal
-    std::string ident;
-};
+symbol intern(std::string_view);
+const std::string& name_of(symbol);
 
 struct unexpected_token: std::exception {
     std::string desc;
@@ -69,25 +78,49 @@ struct unexpected_token: std::exception {
     unexpected_token(std::string desc): desc(desc) {}
 };
 
+// Tokens are stored as a struct of arrays,
+// and handed out as indices into them.
 class tstream {
-    std::vector<token> tokens;
+    std::vector<token_type> kinds;
+    // For K_NUM, this is the value;
+    // For K_IDENT, this is identifier;
+    // For K_STR, this is the content of the string literal
+    std::vector<int> vals;
+    // Where the token is in the source
+    std::vector<int> offsets;
+    std::vector<int> lens;
+
+    std::string_view src;
     int curr;
     int memory;
+
+    void push(token_type ty, int val, int offset, int len);
 public:
-    void tokenize(std::string);
+    // Lexes a whole translation unit in a single pass.
+    void tokenize(std::string_view);
     void retreat() { curr--; }
-    token peek() { return tokens[curr]; }
-    token consume() { return tokens[curr++]; }
+    token_type peek() { return kinds[curr]; }
+    // Returns index of the consumed token.
+    int consume() { return curr++; }
+
+    token_type kind(int i) { return kinds[i]; }
+    int val(int i) { return vals[i]; }
+    std::string_view text(int i) { return src.substr(offsets[i], lens[i]); }
 
     int save() { return memory = curr; }
     void load(int x) { curr = x; }
     void load() { curr = memory; }
 
-    void seteof() { tokens.push_back({ K_EOF }); }
+    void seteof() { push(K_EOF, 0, src.size(), 0); }
+    int size() { return kinds.size(); }
 };
 
 extern tstream tin;
 
+// Returns the whole source text.
+// If path is given, the file is memory-mapped; otherwise stdin is read in one go.
+std::string_view read_source(const char* path=nullptr);
+
 // Consumes the next token and sees if it is t. Throws if not.
 void expect(token_type t);
 
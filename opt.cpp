@@ -0,0 +1,844 @@
+#include "opt.h"
+#include "ssa.h"
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+
+// Computes `a op b` as the machine would, wrapping around on overflow.
+// Returns false if op can't be computed, or would trap.
+bool evaluate(ir_type op, long a, long b, long& res) {
+    unsigned long x = a, y = b;
+    switch (op) {
+    case I_ADD: res = x + y; return true;
+    case I_SUB: res = x - y; return true;
+    case I_IMUL: res = x * y; return true;
+    case I_IDIV:
+    case I_MOD:
+        if (b == 0 || b == -1 && a == LONG_MIN)
+            return false;
+        res = op == I_IDIV ? a / b : a % b;
+        return true;
+    case I_LE: res = a < b; return true;
+    case I_GE: res = a > b; return true;
+    case I_LEQ: res = a <= b; return true;
+    case I_GEQ: res = a >= b; return true;
+    case I_EQ: res = a == b; return true;
+    case I_NEQ: res = a != b; return true;
+    default: return false;
+    }
+}
+
+// k if x is 2 to the k, where k > 0; otherwise -1.
+int exact_log2(long x) {
+    if (x <= 1 || x & (x - 1))
+        return -1;
+    return __builtin_ctzl(x);
+}
+
+// Whether x computes its result from its operands alone, and can't trap.
+bool is_pure(ir* x) {
+    switch (x->ty) {
+    case I_IMM:
+    case I_ADD:
+    case I_SUB:
+    case I_IMUL:
+    case I_SHL:
+    case I_SAR:
+    case I_SHR:
+    case I_MULHI:
+    case I_LEA:
+    case I_LE:
+    case I_GE:
+    case I_LEQ:
+    case I_GEQ:
+    case I_EQ:
+    case I_NEQ:
+    case I_SEXT:
+    case I_LOCALREF:
+    case I_GLOBALREF:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Removes pure instructions whose results no instruction reads.
+void remove_unused(cfg& bs) {
+    bool changed;
+    do {
+        std::unordered_set<reg*> used;
+        for (auto b : bs)
+            for (auto x : b->irs)
+                for (auto r : uses(x))
+                    used.insert(r);
+
+        changed = false;
+        for (auto b : bs) {
+            auto& v = b->irs;
+            auto end = std::remove_if(v.begin(), v.end(), [&](ir* x) {
+                return is_pure(x) && !used.count(x->a0);
+            });
+            changed |= end != v.end();
+            v.erase(end, v.end());
+        }
+    } while (changed);
+}
+
+// Registers replaced by others holding the same value, for passes that remove
+// instructions whose result is already known.
+struct aliases {
+    std::unordered_map<reg*, reg*> alias;
+
+    reg* resolve(reg* r) {
+        for (auto it = alias.find(r); it != alias.end(); it = alias.find(r))
+            r = it->second;
+        return r;
+    }
+
+    // Makes x read the registers replacing its operands.
+    void rewrite(ir* x) {
+        for (auto r : uses(x))
+            replace_use(x, r, resolve(r));
+    }
+
+    // Rewrites every instruction once the pass is done, as phis may read registers defined later.
+    void rewrite(cfg& bs) {
+        for (auto b : bs)
+            for (auto x : b->irs)
+                rewrite(x);
+    }
+};
+
+struct folder : aliases {
+    cfg& bs;
+
+    // Registers holding a known value
+    std::unordered_map<reg*, long> consts;
+    bool changed = false;
+    // Whether a branch became a jump
+    bool edges_removed = false;
+
+    folder(cfg& bs): bs(bs) {}
+
+    bool constant(reg* r, long& v) {
+        auto it = consts.find(r);
+        if (it == consts.end())
+            return false;
+        v = it->second;
+        return true;
+    }
+
+    void to_imm(ir* x, long v) {
+        x->ty = I_IMM;
+        x->imm = v;
+        x->a1 = x->a2 = nullptr;
+        consts[x->a0] = v;
+        changed = true;
+    }
+
+    // The result of x is the value of r; x goes away.
+    bool same_as(ir* x, reg* r) {
+        alias[x->a0] = r;
+        changed = true;
+        return false;
+    }
+
+    // b always goes to `to`; the other successor loses the edge.
+    void to_jmp(block* b, ir* x, block* to) {
+        block* other = x->to == to ? x->els : x->to;
+        if (other != to)
+            for (auto y : other->irs) {
+                if (y->ty != I_PHI)
+                    break;
+                for (int i = y->from.size() - 1; i >= 0; i--)
+                    if (y->from[i] == b) {
+                        y->from.erase(y->from.begin() + i);
+                        y->params.erase(y->params.begin() + i);
+                    }
+            }
+
+        x->ty = I_JMP;
+        x->a0 = x->a1 = x->a2 = nullptr;
+        x->to = to;
+        x->els = nullptr;
+        changed = edges_removed = true;
+    }
+
+    // Returns false if x is to be removed.
+    bool simplify(block* b, ir* x) {
+        long u, v;
+        bool c1 = x->a1 && constant(x->a1, u);
+        bool c2 = x->a2 && constant(x->a2, v);
+
+        switch (x->ty) {
+        case I_IMM:
+            consts[x->a0] = x->imm;
+            return true;
+        case I_ADD:
+        case I_SUB:
+        case I_IMUL:
+        case I_IDIV:
+        case I_MOD:
+        case I_LE:
+        case I_GE:
+        case I_LEQ:
+        case I_GEQ:
+        case I_EQ:
+        case I_NEQ: {
+            long res;
+            if (c1 && c2 && evaluate(x->ty, u, v, res)) {
+                to_imm(x, res);
+                return true;
+            }
+            break;
+        }
+        case I_SHL:
+            if (c1) {
+                to_imm(x, (unsigned long) u << x->imm);
+                return true;
+            }
+            return true;
+        case I_SEXT:
+            if (c1) {
+                to_imm(x, x->sz == 1 ? (long) (signed char) u : x->sz == 2 ? (long) (short) u : x->sz == 4 ? (long) (int) u : u);
+                return true;
+            }
+            return true;
+        case I_PHI: {
+            reg* only = nullptr;
+            for (auto p : x->params)
+                if (p != x->a0 && p != only) {
+                    if (only)
+                        return true;
+                    only = p;
+                }
+            return only ? same_as(x, only) : true;
+        }
+        case I_BR: {
+            if (x->a0) {
+                if (constant(x->a0, u))
+                    to_jmp(b, x, u ? x->to : x->els);
+                return true;
+            }
+            long res;
+            if (c1 && c2 && evaluate(x->cmp, u, v, res))
+                to_jmp(b, x, res ? x->to : x->els);
+            else if (x->a1 == x->a2)
+                to_jmp(b, x, x->cmp == I_EQ || x->cmp == I_LEQ || x->cmp == I_GEQ ? x->to : x->els);
+            return true;
+        }
+        default:
+            return true;
+        }
+
+        // Identities, with the constant moved to the right where possible
+        if (c1 && (x->ty == I_ADD || x->ty == I_IMUL)) {
+            std::swap(x->a1, x->a2);
+            std::swap(u, v);
+            std::swap(c1, c2);
+        }
+
+        switch (x->ty) {
+        case I_ADD:
+            if (c2 && v == 0)
+                return same_as(x, x->a1);
+            break;
+        case I_SUB:
+            if (c2 && v == 0)
+                return same_as(x, x->a1);
+            if (x->a1 == x->a2)
+                to_imm(x, 0);
+            break;
+        case I_IMUL:
+            if (!c2)
+                break;
+            if (v == 0)
+                to_imm(x, 0);
+            else if (v == 1)
+                return same_as(x, x->a1);
+            else if (int k = exact_log2(v); k > 0) {
+                x->ty = I_SHL;
+                x->imm = k;
+                x->a2 = nullptr;
+                changed = true;
+            }
+            break;
+        case I_IDIV:
+            if (c2 && v == 1)
+                return same_as(x, x->a1);
+            break;
+        case I_MOD:
+            if (c2 && (v == 1 || v == -1))
+                to_imm(x, 0);
+            break;
+        case I_LE:
+        case I_GE:
+        case I_LEQ:
+        case I_GEQ:
+        case I_EQ:
+        case I_NEQ:
+            if (x->a1 == x->a2)
+                to_imm(x, x->ty == I_EQ || x->ty == I_LEQ || x->ty == I_GEQ);
+            break;
+        default:
+            break;
+        }
+        return true;
+    }
+
+    void run() {
+        do {
+            changed = edges_removed = false;
+            for (auto b : bs) {
+                std::vector<ir*> out;
+                for (auto x : b->irs) {
+                    rewrite(x);
+                    if (simplify(b, x))
+                        out.push_back(x);
+                }
+                b->irs = out;
+            }
+
+            rewrite(bs);
+
+            if (edges_removed)
+                prune(bs);
+        } while (changed);
+
+        remove_unused(bs);
+    }
+};
+
+void fold(cfg& bs) {
+    folder(bs).run();
+}
+
+struct numberer : aliases {
+    cfg& bs;
+
+    // What an instruction computes; loads of the same address share the key
+    using key = std::tuple<ir_type, reg*, reg*, long, int, int, var*>;
+
+    // Values computed in the blocks dominating the current one
+    std::map<key, reg*> avail;
+
+    numberer(cfg& bs): bs(bs) {}
+
+    key key_of(ir* x) {
+        reg* a1 = x->a1;
+        reg* a2 = x->a2;
+        if ((x->ty == I_ADD || x->ty == I_IMUL || x->ty == I_EQ || x->ty == I_NEQ) && a1 && a2 && a1->ind > a2->ind)
+            std::swap(a1, a2);
+        return { x->ty, a1, a2, x->imm, x->scale, x->sz, x->v };
+    }
+
+    // Constants and addresses of variables cost no more to compute again
+    // than to keep in a register, maybe across calls.
+    static bool cheap(ir* x) {
+        return x->ty == I_IMM || x->ty == I_LOCALREF || x->ty == I_GLOBALREF;
+    }
+
+    // loads holds the values in memory when b is entered.
+    void visit(block* b, std::map<key, reg*> loads) {
+        std::vector<key> added;
+        std::vector<ir*> out;
+        for (auto x : b->irs) {
+            rewrite(x);
+
+            if (x->ty == I_LOAD) {
+                key k = key_of(x);
+                if (auto it = loads.find(k); it != loads.end()) {
+                    alias[x->a0] = it->second;
+                    continue;
+                }
+                loads[k] = x->a0;
+            } else if (x->ty == I_STORE || x->ty == I_CALL || x->ty == I_RMW) {
+                loads.clear();
+                // A later load gets back what is stored, unless it is truncated
+                if (x->ty == I_STORE && x->sz == 8)
+                    loads[{ I_LOAD, x->a0, x->a2, x->imm, x->scale, x->sz, x->v }] = x->a1;
+            } else if (is_pure(x) && !cheap(x) || x->ty == I_IDIV || x->ty == I_MOD) {
+                key k = key_of(x);
+                if (auto it = avail.find(k); it != avail.end()) {
+                    alias[x->a0] = it->second;
+                    continue;
+                }
+                avail[k] = x->a0;
+                added.push_back(k);
+            }
+            out.push_back(x);
+        }
+        b->irs = out;
+
+        // Memory is unchanged on the way to a block only b leads to
+        for (auto c : b->doms)
+            visit(c, c->preds.size() == 1 ? loads : std::map<key, reg*>());
+        for (auto& k : added)
+            avail.erase(k);
+    }
+
+    void run() {
+        dominators(bs);
+        visit(bs[0], {});
+        rewrite(bs);
+    }
+};
+
+void gvn(cfg& bs) {
+    numberer(bs).run();
+}
+
+bool fits_imm32(long v) {
+    return v >= INT_MIN && v <= INT_MAX;
+}
+
+// The comparison that holds for (b, a) when cmp holds for (a, b)
+std::map<ir_type, ir_type> mirror {
+    { I_LE, I_GE }, { I_GE, I_LE }, { I_LEQ, I_GEQ }, { I_GEQ, I_LEQ }, { I_EQ, I_EQ }, { I_NEQ, I_NEQ },
+};
+
+// Magic number for signed division by d, where |d| >= 2, after Hacker's Delight 10-1.
+// n / d is the high half of n * m shifted right by s, corrected by n if m has the wrong sign,
+// and rounded towards zero.
+struct magic {
+    long m;
+    int s;
+};
+
+magic signed_magic(long d) {
+    const unsigned long two63 = 1UL << 63;
+    unsigned long ad = d < 0 ? -(unsigned long) d : d;
+    unsigned long t = two63 + ((unsigned long) d >> 63);
+    unsigned long anc = t - 1 - t % ad;
+    int p = 63;
+    unsigned long q1 = two63 / anc, r1 = two63 - q1 * anc;
+    unsigned long q2 = two63 / ad, r2 = two63 - q2 * ad;
+    unsigned long delta;
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || q1 == delta && r1 == 0);
+
+    long m = q2 + 1;
+    return { d < 0 ? -m : m, p - 64 };
+}
+
+struct reducer {
+    cfg& bs;
+
+    std::unordered_map<reg*, long> consts;
+    // Code replacing the current block
+    std::vector<ir*> out;
+
+    reducer(cfg& bs): bs(bs) {}
+
+    bool constant(reg* r, long& v) {
+        auto it = consts.find(r);
+        if (!r || it == consts.end())
+            return false;
+        v = it->second;
+        return true;
+    }
+
+    reg* emit(ir_type ty, reg* a1, reg* a2) {
+        reg* a0 = new reg;
+        out.push_back(new ir(ty, a0, a1, a2));
+        return a0;
+    }
+
+    reg* emit(ir_type ty, reg* a1, long imm) {
+        reg* a0 = new reg;
+        ir* x = new ir(ty, a0, a1);
+        x->imm = imm;
+        out.push_back(x);
+        return a0;
+    }
+
+    // Emits n / d, where d is neither 0, 1 nor -1.
+    reg* divide(reg* n, long d) {
+        unsigned long ad = d < 0 ? -(unsigned long) d : d;
+        if (ad & (ad - 1)) {
+            magic mg = signed_magic(d);
+            reg* q = emit(I_MULHI, n, mg.m);
+            if (d > 0 && mg.m < 0)
+                q = emit(I_ADD, q, n);
+            if (d < 0 && mg.m > 0)
+                q = emit(I_SUB, q, n);
+            if (mg.s)
+                q = emit(I_SAR, q, mg.s);
+            return emit(I_ADD, q, emit(I_SHR, q, 63));
+        }
+
+        // Negative n is rounded towards zero by adding 2^k - 1 first
+        int k = __builtin_ctzl(ad);
+        reg* bias = emit(I_SHR, k == 1 ? n : emit(I_SAR, n, 63), 64 - k);
+        reg* q = emit(I_SAR, emit(I_ADD, n, bias), k);
+        return d < 0 ? emit(I_IMUL, q, -1) : q;
+    }
+
+    // Rewrites x, appending it or what replaces it to out.
+    void select(ir* x) {
+        long u, v;
+        bool c1 = constant(x->a1, u);
+        bool c2 = constant(x->a2, v);
+
+        switch (x->ty) {
+        case I_IMM:
+            consts[x->a0] = x->imm;
+            break;
+        case I_ADD:
+        case I_IMUL:
+            if (c1 && !c2) {
+                std::swap(x->a1, x->a2);
+                std::swap(u, v);
+                std::swap(c1, c2);
+            }
+            // fallthrough
+        case I_SUB:
+            if (c2 && fits_imm32(v)) {
+                x->a2 = nullptr;
+                x->imm = v;
+            }
+            // x*3, x*5 and x*9 are x + x*2, x + x*4 and x + x*8
+            if (x->ty == I_IMUL && !x->a2 && (x->imm == 3 || x->imm == 5 || x->imm == 9)) {
+                x->ty = I_LEA;
+                x->a2 = x->a1;
+                x->scale = x->imm - 1;
+                x->imm = 0;
+            }
+            break;
+        case I_LE:
+        case I_GE:
+        case I_LEQ:
+        case I_GEQ:
+        case I_EQ:
+        case I_NEQ:
+        case I_BR: {
+            if (x->ty == I_BR && x->a0)
+                break;
+            ir_type& cmp = x->ty == I_BR ? x->cmp : x->ty;
+            if (c1 && !c2) {
+                std::swap(x->a1, x->a2);
+                std::swap(v, u);
+                std::swap(c1, c2);
+                cmp = mirror[cmp];
+            }
+            if (c2 && fits_imm32(v)) {
+                x->a2 = nullptr;
+                x->imm = v;
+            }
+            break;
+        }
+        case I_IDIV:
+        case I_MOD: {
+            if (!c2 || v == 0 || v == 1 || v == -1)
+                break;
+            reg* n = x->a1;
+            unsigned long av = v < 0 ? -(unsigned long) v : v;
+            if (x->ty == I_IDIV)
+                divide(n, v);
+            else if (av & (av - 1)) {
+                reg* q = divide(n, v);
+                emit(I_SUB, n, fits_imm32(v) ? emit(I_IMUL, q, v) : emit(I_IMUL, q, x->a2));
+            } else // n % d has the sign of n, so only |d| matters
+                emit(I_SUB, n, emit(I_SHL, divide(n, av), __builtin_ctzl(av)));
+            out.back()->a0 = x->a0;
+            return;
+        }
+        default:
+            break;
+        }
+        out.push_back(x);
+    }
+
+    void run() {
+        for (auto b : bs) {
+            out.clear();
+            for (auto x : b->irs)
+                select(x);
+            b->irs = out;
+        }
+        remove_unused(bs);
+    }
+};
+
+void reduce(cfg& bs) {
+    reducer(bs).run();
+}
+
+struct addresser {
+    cfg& bs;
+
+    // The instruction defining each register
+    std::unordered_map<reg*, ir*> defs;
+
+    addresser(cfg& bs): bs(bs) {}
+
+    ir* def_of(reg* r) {
+        auto it = defs.find(r);
+        return it == defs.end() ? nullptr : it->second;
+    }
+
+    // k if r is x shifted left by k, and k can be a scale; otherwise 0.
+    int shift(reg* r) {
+        ir* d = def_of(r);
+        return d && d->ty == I_SHL && d->imm <= 3 ? d->imm : 0;
+    }
+
+    // Matches the address in base against base + index*scale + disp,
+    // or against a variable in place of base; the result goes to x.
+    void match(ir* x, reg*& base) {
+        reg* index = nullptr;
+        int scale = 1;
+        long disp = 0;
+
+        for (ir* d; base && (d = def_of(base)); ) {
+            if ((d->ty == I_ADD || d->ty == I_SUB) && !d->a2) {
+                long nd = disp + (d->ty == I_ADD ? d->imm : -d->imm);
+                if (!fits_imm32(nd))
+                    break;
+                disp = nd;
+                base = d->a1;
+            } else if (d->ty == I_ADD && !index) {
+                reg* b = d->a1;
+                index = d->a2;
+                if (shift(b) && !shift(index))
+                    std::swap(b, index);
+                base = b;
+
+                if (int k = shift(index)) {
+                    index = def_of(index)->a1;
+                    scale = 1 << k;
+                }
+                // (i + c) * scale is i * scale + c * scale
+                for (ir* e; (e = def_of(index)) && (e->ty == I_ADD || e->ty == I_SUB) && !e->a2; index = e->a1) {
+                    long nd = disp + (e->ty == I_ADD ? e->imm : -e->imm) * scale;
+                    if (!fits_imm32(e->imm) || !fits_imm32(nd))
+                        break;
+                    disp = nd;
+                }
+            } else if (d->ty == I_LOCALREF || d->ty == I_GLOBALREF) {
+                x->v = d->v;
+                base = nullptr;
+            } else
+                break;
+        }
+
+        x->a2 = index;
+        x->scale = scale;
+        x->imm = disp;
+    }
+
+    void run() {
+        for (auto b : bs)
+            for (auto x : b->irs)
+                if (def(x))
+                    defs[def(x)] = x;
+
+        for (auto b : bs)
+            for (auto x : b->irs) {
+                if (x->ty == I_LOAD)
+                    match(x, x->a1);
+                if (x->ty == I_STORE)
+                    match(x, x->a0);
+            }
+        remove_unused(bs);
+    }
+};
+
+void select_addresses(cfg& bs) {
+    addresser(bs).run();
+}
+
+// Whether v is a signed integer of sz bytes, or an imm32 if sz is 8.
+bool fits_size(long v, int sz) {
+    if (sz == 8)
+        return fits_imm32(v);
+    long half = 1L << (sz * 8 - 1);
+    return v >= -half && v < half;
+}
+
+// Whether load l reads the memory that store x writes.
+bool same_address(ir* l, ir* x) {
+    return l->a1 == x->a0 && l->a2 == x->a2 && l->scale == x->scale && l->imm == x->imm && l->v == x->v && l->sz == x->sz;
+}
+
+void fold_loads(cfg& bs) {
+    std::unordered_map<reg*, int> count;
+    for (auto b : bs)
+        for (auto x : b->irs)
+            for (auto r : uses(x))
+                count[r]++;
+
+    for (auto b : bs) {
+        // Loads, adds and subs since the last instruction that may write memory
+        std::unordered_map<reg*, ir*> loads;
+        std::unordered_map<reg*, ir*> arith;
+        std::unordered_set<ir*> folded;
+
+        // The load defining r, if x is its only reader
+        auto take = [&](reg* r) -> ir* {
+            auto it = r ? loads.find(r) : loads.end();
+            return it == loads.end() || count[r] != 1 ? nullptr : it->second;
+        };
+        auto fold = [&](ir* x, ir* load) {
+            x->mem = load;
+            load->a0 = nullptr;
+            folded.insert(load);
+        };
+
+        for (auto x : b->irs) {
+            switch (x->ty) {
+            case I_BR:
+                if (x->a0) {
+                    if (ir* l = take(x->a0)) {
+                        x->a0 = nullptr;
+                        x->cmp = I_NEQ;
+                        x->imm = 0;
+                        fold(x, l);
+                    }
+                    break;
+                }
+                // fallthrough
+            case I_LE:
+            case I_GE:
+            case I_LEQ:
+            case I_GEQ:
+            case I_EQ:
+            case I_NEQ: {
+                ir_type& cmp = x->ty == I_BR ? x->cmp : x->ty;
+                // Loads of any size compare to immediates that fit
+                if (!x->a2) {
+                    if (ir* l = take(x->a1); l && fits_size(x->imm, l->sz)) {
+                        x->a1 = nullptr;
+                        fold(x, l);
+                    }
+                    break;
+                }
+                if (ir* l = take(x->a1); l && l->sz == 8 && !take(x->a2)) {
+                    std::swap(x->a1, x->a2);
+                    cmp = mirror[cmp];
+                }
+                if (ir* l = take(x->a2); l && l->sz == 8) {
+                    x->a2 = nullptr;
+                    fold(x, l);
+                }
+                break;
+            }
+            case I_ADD:
+            case I_IMUL:
+                if (ir* l = take(x->a1); l && l->sz == 8 && x->a2 && !take(x->a2))
+                    std::swap(x->a1, x->a2);
+                // fallthrough
+            case I_SUB:
+                if (ir* l = take(x->a2); l && l->sz == 8) {
+                    x->a2 = nullptr;
+                    fold(x, l);
+                }
+                if (x->ty != I_IMUL)
+                    arith[x->a0] = x;
+                break;
+            case I_LOAD:
+                loads[x->a0] = x;
+                break;
+            case I_STORE:
+                // Storing back what is loaded, plus or minus something, changes memory in place
+                if (auto it = arith.find(x->a1); it != arith.end() && count[x->a1] == 1) {
+                    ir* d = it->second;
+                    ir* l = nullptr;
+                    reg* other = nullptr;
+                    if (d->mem) {
+                        // a1 - [mem] is not in place
+                        if (d->ty == I_ADD)
+                            l = d->mem;
+                        other = d->a1;
+                    } else if ((l = take(d->a1)))
+                        other = d->a2;
+                    else if (d->ty == I_ADD && (l = take(d->a2)))
+                        other = d->a1;
+
+                    if (l && same_address(l, x) && (other || fits_size(d->imm, x->sz))) {
+                        x->ty = I_RMW;
+                        x->op = d->ty;
+                        x->a0 = x->a2 = nullptr;
+                        x->v = nullptr;
+                        x->a1 = other;
+                        x->imm = other ? 0 : d->imm;
+                        fold(x, l);
+                        folded.insert(d);
+                    }
+                }
+                // fallthrough
+            case I_CALL:
+                loads.clear();
+                arith.clear();
+                break;
+            default:
+                break;
+            }
+        }
+
+        auto& v = b->irs;
+        v.erase(std::remove_if(v.begin(), v.end(), [&](ir* x) { return folded.count(x); }), v.end());
+    }
+}
+
+void dce(func* f, cfg& bs) {
+    // Locals only ever stored to: their address is not taken, and no load reads them
+    std::unordered_set<var*> read;
+    for (auto b : bs)
+        for (auto x : b->irs) {
+            if (x->ty == I_LOCALREF || x->ty == I_LOAD)
+                read.insert(x->v);
+            if (x->mem)
+                read.insert(x->mem->v);
+        }
+    std::unordered_set<var*> unread;
+    for (auto v : f->frame)
+        if (!read.count(v))
+            unread.insert(v);
+    auto& fr = f->frame;
+    fr.erase(std::remove_if(fr.begin(), fr.end(), [&](var* v) { return unread.count(v); }), fr.end());
+
+    // Instructions are live if they have effects, or compute what a live one reads
+    std::unordered_map<reg*, ir*> defs;
+    std::unordered_set<ir*> live;
+    std::vector<ir*> work;
+    for (auto b : bs)
+        for (auto x : b->irs) {
+            if (def(x))
+                defs[def(x)] = x;
+            bool dead_store = x->ty == I_STORE && x->v && unread.count(x->v);
+            if (x->ty == I_STORE && !dead_store || x->ty == I_CALL || x->ty == I_RMW || is_terminator(x)) {
+                live.insert(x);
+                work.push_back(x);
+            }
+        }
+    while (!work.empty()) {
+        ir* x = work.back();
+        work.pop_back();
+        for (auto r : uses(x))
+            if (auto it = defs.find(r); it != defs.end() && live.insert(it->second).second)
+                work.push_back(it->second);
+    }
+
+    for (auto b : bs) {
+        auto& v = b->irs;
+        v.erase(std::remove_if(v.begin(), v.end(), [&](ir* x) { return !live.count(x); }), v.end());
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "ir.h"
+
+// Passes over the IR in SSA form.
+
+// Folds operations on constants, and simplifies x+0, x*1, x*2^k etc.
+// Branches on constants become jumps, and blocks no longer reached are removed.
+void fold(cfg&);
+
+// Removes instructions computing a value already computed in a dominating block,
+// and loads of memory that hasn't been written since it was last read.
+void gvn(cfg&);
+
+// Gives constant operands to instructions as immediates, and replaces
+// multiplication and division by constants with cheaper instructions.
+void reduce(cfg&);
+
+// Folds address arithmetic into loads and stores, which address memory
+// as [base + index*scale + disp], with base a register, a local or a global.
+void select_addresses(cfg&);
+
+// Lets arithmetic and comparisons read their operand straight from memory,
+// where it is loaded just for them and nothing is stored in between.
+// Memory loaded, added to and stored back is changed in place by I_RMW.
+void fold_loads(cfg&);
+
+// Removes instructions whose results are never used, including cycles of phis,
+// and stores to locals that are never read; those lose their stack slot.
+void dce(func*, cfg&);
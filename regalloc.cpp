@@ -0,0 +1,1097 @@
+#include "regalloc.h"
+#include "ssa.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+// Registers with no fixed use are preferred.
+// Arguments come in rdi, rsi, rdx, rcx, r8 and r9; idiv and imul take rax and rdx.
+const char* regs[] = {
+    "r10", "r11", "r9", "r8", "rcx", "rsi", "rdi", "rdx", "rax",
+    "rbx", "r12", "r13", "r14", "r15"
+};
+const int rsz = sizeof(regs) / sizeof(const char*);
+const int callee_saved = 9;
+
+int reg_index(std::string_view name) {
+    for (int i = 0; i < rsz; i++)
+        if (name == regs[i])
+            return i;
+    throw std::runtime_error("unknown register");
+}
+
+// Where the argument of each index comes in
+const char* arg_regs[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
+
+bool coloring = false;
+
+// Positions in the layout: the k-th instruction reads its operands at 2k
+// and writes its result at 2k + 1.
+// Moves between parts of a split register go right before an instruction.
+const int INF = INT_MAX;
+
+// Where a register is live, or a part of it after splitting.
+struct interval {
+    // The register it is a part of
+    reg* vreg;
+    // The register standing for this part in the code.
+    // Either real is the location, or it is spilt to the slot of vreg.
+    reg* r;
+    // Sorted, disjoint and half-open
+    std::vector<std::pair<int, int>> ranges;
+    // Positions where the value must be in a register
+    std::vector<int> uses;
+
+    int start() { return ranges.front().first; }
+    int end() { return ranges.back().second; }
+
+    bool covers(int pos) {
+        auto it = std::upper_bound(ranges.begin(), ranges.end(), std::make_pair(pos, INF));
+        return it != ranges.begin() && pos < (--it)->second;
+    }
+
+    int next_use(int pos) {
+        auto it = std::lower_bound(uses.begin(), uses.end(), pos);
+        return it == uses.end() ? INF : *it;
+    }
+
+    // The first position where both are live.
+    int intersect(interval* o) {
+        auto i = ranges.begin(), j = o->ranges.begin();
+        while (i != ranges.end() && j != o->ranges.end()) {
+            int lo = std::max(i->first, j->first);
+            if (lo < std::min(i->second, j->second))
+                return lo;
+            if (i->second < j->second)
+                i++;
+            else
+                j++;
+        }
+        return INF;
+    }
+
+    // Moves everything from pos on into a new part.
+    interval* split(int pos) {
+        interval* c = new interval { vreg, new reg };
+
+        std::vector<std::pair<int, int>> keep;
+        for (auto [from, to] : ranges) {
+            if (to <= pos)
+                keep.push_back({ from, to });
+            else if (from >= pos)
+                c->ranges.push_back({ from, to });
+            else {
+                keep.push_back({ from, pos });
+                c->ranges.push_back({ pos, to });
+            }
+        }
+        ranges = keep;
+
+        auto mid = std::lower_bound(uses.begin(), uses.end(), pos);
+        c->uses.assign(mid, uses.end());
+        uses.erase(mid, uses.end());
+        return c;
+    }
+};
+
+// Set of registers, by their index within the function.
+struct bits {
+    std::vector<uint64_t> w;
+
+    explicit bits(int n = 0): w((n + 63) / 64) {}
+
+    void set(int i) { w[i / 64] |= 1ull << i % 64; }
+    void reset(int i) { w[i / 64] &= ~(1ull << i % 64); }
+    bool test(int i) { return w[i / 64] >> i % 64 & 1; }
+
+    std::vector<int> members() {
+        std::vector<int> res;
+        for (int i = 0; i < w.size(); i++)
+            for (uint64_t x = w[i]; x; x &= x - 1)
+                res.push_back(i * 64 + __builtin_ctzll(x));
+        return res;
+    }
+};
+
+// A copy of vreg from one location to another.
+struct move {
+    reg* vreg;
+    reg* from;
+    reg* to;
+};
+
+// Registers of a function and where they are live.
+struct liveness {
+    func* f;
+    cfg& bs;
+
+    // Registers of the function, numbered
+    std::unordered_map<reg*, int> index;
+    std::vector<reg*> vregs;
+
+    std::unordered_map<block*, int> bid;
+    std::vector<bits> live_in;
+
+    liveness(func* f, cfg& bs): f(f), bs(bs) {}
+
+    int id(reg* r) {
+        auto [it, fresh] = index.emplace(r, vregs.size());
+        if (fresh)
+            vregs.push_back(r);
+        return it->second;
+    }
+
+    var* slot(reg* vreg) {
+        if (!vreg->dest) {
+            var* v = make<var>();
+            v->ty = type::ptr(type::int_t);
+            f->frame.push_back(v);
+            vreg->dest = v;
+        }
+        return vreg->dest;
+    }
+
+    // Registers x reads, except those already spilt for good
+    static std::vector<reg*> reads(ir* x) {
+        std::vector<reg*> rs = uses(x);
+        rs.erase(std::remove_if(rs.begin(), rs.end(), [](reg* r) { return r->spilt; }), rs.end());
+        return rs;
+    }
+
+    bits live_out(int i) {
+        bits out(vregs.size());
+        for (auto s : bs[i]->succs)
+            for (int k = 0; k < out.w.size(); k++)
+                out.w[k] |= live_in[bid[s]].w[k];
+        return out;
+    }
+
+    void solve() {
+        int n = bs.size();
+        for (int i = 0; i < n; i++)
+            bid[bs[i]] = i;
+        for (auto b : bs)
+            for (auto x : b->irs) {
+                for (auto r : reads(x))
+                    id(r);
+                if (reg* d = def(x))
+                    id(d);
+            }
+
+        int m = vregs.size();
+        std::vector<bits> gen(n, bits(m)), kill(n, bits(m));
+        for (int i = 0; i < n; i++)
+            for (auto x : bs[i]->irs) {
+                for (auto r : reads(x))
+                    if (!kill[i].test(id(r)))
+                        gen[i].set(id(r));
+                if (reg* d = def(x))
+                    kill[i].set(id(d));
+            }
+
+        live_in.assign(n, bits(m));
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (int i = n - 1; i >= 0; i--) {
+                bits out = live_out(i);
+                bits& in = live_in[i];
+                for (int k = 0; k < in.w.size(); k++) {
+                    uint64_t x = gen[i].w[k] | out.w[k] & ~kill[i].w[k];
+                    if (x != in.w[k]) {
+                        in.w[k] = x;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+};
+
+struct linear_scan : liveness {
+    // All parts of each register
+    std::vector<std::vector<interval*>> parts;
+
+    // Position of the first instruction of each block, and the end of it
+    std::vector<std::pair<int, int>> span;
+
+    // Moves to make before the instruction at each position
+    std::unordered_map<int, std::vector<move>> moves;
+
+    // Where each real register is taken by a fixed use
+    std::vector<interval> fixed;
+
+    // Positions of calls
+    std::vector<int> calls;
+
+    linear_scan(func* f, cfg& bs): liveness(f, bs) {}
+
+    // Must run after build(), which lays out positions.
+    void build_fixed() {
+        fixed.resize(rsz);
+        auto take = [&](const char* name, int from, int to) {
+            auto& rs = fixed[reg_index(name)].ranges;
+            if (from >= to)
+                return;
+            if (!rs.empty() && rs.back().second >= from)
+                rs.back().second = std::max(rs.back().second, to);
+            else
+                rs.push_back({ from, to });
+        };
+
+        // Arguments stay in their registers until read
+        int p = span[0].first;
+        for (auto x : bs[0]->irs) {
+            if (x->ty == I_ARG)
+                take(arg_regs[x->imm], span[0].first, p);
+            p += 2;
+        }
+
+        for (int i = 0; i < bs.size(); i++) {
+            p = span[i].first;
+            for (auto x : bs[i]->irs) {
+                if (x->ty == I_IDIV || x->ty == I_MOD || x->ty == I_MULHI) {
+                    take("rax", p, p + 1);
+                    take("rdx", p, p + 1);
+                }
+                p += 2;
+            }
+        }
+    }
+
+    // Builds intervals walking backwards, so ranges and uses are collected in reverse.
+    void build() {
+        int pos = 2;
+        for (auto b : bs) {
+            span.push_back({ pos, pos + 2 * (int) b->irs.size() });
+            pos += 2 * b->irs.size();
+        }
+
+        parts.resize(vregs.size());
+        for (int i = 0; i < vregs.size(); i++)
+            parts[i].push_back(new interval { vregs[i], vregs[i] });
+
+        auto add_range = [&](reg* r, int from, int to) {
+            auto& rs = parts[id(r)][0]->ranges;
+            if (!rs.empty() && rs.back().first <= to) {
+                rs.back().first = std::min(rs.back().first, from);
+                rs.back().second = std::max(rs.back().second, to);
+            } else
+                rs.push_back({ from, to });
+        };
+
+        for (int i = bs.size() - 1; i >= 0; i--) {
+            auto [from, to] = span[i];
+            for (auto k : live_out(i).members())
+                add_range(vregs[k], from, to);
+
+            auto& irs = bs[i]->irs;
+            for (int j = irs.size() - 1; j >= 0; j--) {
+                ir* x = irs[j];
+                int p = from + 2 * j;
+                if (x->ty == I_CALL)
+                    calls.push_back(p);
+                if (reg* d = def(x)) {
+                    interval* iv = parts[id(d)][0];
+                    auto& rs = iv->ranges;
+                    if (!rs.empty() && rs.back().first <= p + 1 && p + 1 < rs.back().second)
+                        rs.back().first = p + 1;
+                    else // Never used
+                        rs.push_back({ p + 1, p + 2 });
+                    iv->uses.push_back(p + 1);
+                }
+                for (auto r : uses(x)) {
+                    add_range(r, from, p + 1);
+                    // Arguments of calls can be read from stack slots
+                    if (x->ty != I_CALL)
+                        parts[id(r)][0]->uses.push_back(p);
+                }
+            }
+        }
+
+        std::sort(calls.begin(), calls.end());
+        for (auto& ps : parts) {
+            std::reverse(ps[0]->ranges.begin(), ps[0]->ranges.end());
+            std::sort(ps[0]->uses.begin(), ps[0]->uses.end());
+        }
+    }
+
+    // Whether iv holds a value across a call, rather than an argument or the result.
+    bool crosses(interval* iv) {
+        auto it = std::lower_bound(calls.begin(), calls.end(), iv->start());
+        for (; it != calls.end() && *it < iv->end(); it++)
+            if (iv->covers(*it) && iv->covers(*it + 1))
+                return true;
+        return false;
+    }
+
+    // Linear scan, after Wimmer and Mössenböck,
+    // "Optimized Interval Splitting in a Linear Scan Register Allocator".
+    void scan() {
+        auto later = [](interval* a, interval* b) {
+            return a->start() != b->start() ? a->start() > b->start() : a->vreg->ind > b->vreg->ind;
+        };
+        std::priority_queue<interval*, std::vector<interval*>, decltype(later)> unhandled(later);
+        for (auto& ps : parts)
+            unhandled.push(ps[0]);
+
+        std::vector<interval*> active, inactive;
+
+        auto split = [&](interval* iv, int pos) {
+            interval* c = iv->split(pos);
+            parts[id(iv->vreg)].push_back(c);
+            return c;
+        };
+
+        // Puts iv on stack until its next use, and the rest back to unhandled.
+        auto spill = [&](interval* iv, int pos) {
+            int use = iv->next_use(pos);
+            int at = use & ~1;
+            if (use != INF && at <= iv->start()) {
+                // Needs a register right where it starts; that is yet to come
+                if (iv->start() <= pos)
+                    throw std::runtime_error("register allocation failed");
+                unhandled.push(iv);
+                return;
+            }
+            iv->r->spilt = true;
+            if (use != INF)
+                unhandled.push(split(iv, at));
+        };
+
+        while (!unhandled.empty()) {
+            interval* cur = unhandled.top();
+            unhandled.pop();
+            int pos = cur->start();
+
+            auto retire = [&](std::vector<interval*>& from, std::vector<interval*>& to, bool want) {
+                for (int i = 0; i < from.size();) {
+                    interval* iv = from[i];
+                    if (iv->end() <= pos || iv->covers(pos) == want) {
+                        if (iv->end() > pos)
+                            to.push_back(iv);
+                        from.erase(from.begin() + i);
+                    } else
+                        i++;
+                }
+            };
+            retire(active, inactive, false);
+            retire(inactive, active, true);
+
+            // Try a register that is free for a while
+            int free_until[rsz];
+            std::fill(free_until, free_until + rsz, INF);
+            for (auto iv : active)
+                free_until[iv->r->real] = 0;
+            for (auto iv : inactive)
+                free_until[iv->r->real] = std::min(free_until[iv->r->real], iv->intersect(cur));
+            int block_pos[rsz];
+            for (int i = 0; i < rsz; i++) {
+                block_pos[i] = fixed[i].intersect(cur);
+                free_until[i] = std::min(free_until[i], block_pos[i]);
+            }
+
+            int best = std::max_element(free_until, free_until + rsz) - free_until;
+            // A callee-saved register is saved once in the prologue, not around every call
+            if (crosses(cur))
+                for (int i = callee_saved; i < rsz; i++)
+                    if (free_until[i] >= cur->end()) {
+                        best = i;
+                        break;
+                    }
+            int at = free_until[best] & ~1;
+            if (free_until[best] >= cur->end() || at > pos) {
+                if (free_until[best] < cur->end())
+                    unhandled.push(split(cur, at));
+                cur->r->real = best;
+                active.push_back(cur);
+                continue;
+            }
+
+            // All registers are taken; spill whatever is used furthest away
+            int next_use[rsz];
+            std::fill(next_use, next_use + rsz, INF);
+            for (auto iv : active)
+                next_use[iv->r->real] = std::min(next_use[iv->r->real], iv->next_use(pos));
+            for (auto iv : inactive)
+                if (iv->intersect(cur) != INF)
+                    next_use[iv->r->real] = std::min(next_use[iv->r->real], iv->next_use(pos));
+            for (int i = 0; i < rsz; i++)
+                next_use[i] = std::min(next_use[i], block_pos[i]);
+
+            best = std::max_element(next_use, next_use + rsz) - next_use;
+            if (cur->next_use(pos) > next_use[best]) {
+                spill(cur, pos);
+                continue;
+            }
+
+            cur->r->real = best;
+            auto evict = [&](std::vector<interval*>& from, bool all) {
+                for (int i = 0; i < from.size();) {
+                    interval* iv = from[i];
+                    if (iv->r->real != best || !all && iv->intersect(cur) == INF) {
+                        i++;
+                        continue;
+                    }
+                    from.erase(from.begin() + i);
+                    spill(iv->start() < pos ? split(iv, pos) : iv, pos);
+                }
+            };
+            evict(active, true);
+            evict(inactive, false);
+
+            // A fixed use of the register comes before cur ends
+            if (block_pos[best] < cur->end()) {
+                int at = block_pos[best] & ~1;
+                if (at <= pos)
+                    throw std::runtime_error("register allocation failed");
+                unhandled.push(split(cur, at));
+            }
+            active.push_back(cur);
+        }
+    }
+
+    interval* part(reg* vreg, int pos) {
+        for (auto iv : parts[id(vreg)])
+            if (iv->covers(pos))
+                return iv;
+        throw std::runtime_error("register not live");
+    }
+
+    // Emits moves happening at once, ordering them so that
+    // no register is overwritten before being read.
+    void sequence(std::vector<ir*>& out, std::vector<move> mv) {
+        auto emit = [&](move m) {
+            if (m.from->spilt)
+                out.push_back(new ir(I_SPILL_LOAD, m.to, m.from->dest));
+            else
+                out.push_back(new ir(I_MOV, m.to, m.from));
+        };
+
+        while (!mv.empty()) {
+            bool progress = false;
+            for (int i = 0; i < mv.size(); i++) {
+                bool blocked = false;
+                for (int j = 0; j < mv.size(); j++)
+                    if (j != i && !mv[j].from->spilt && mv[j].from->real == mv[i].to->real)
+                        blocked = true;
+                if (blocked)
+                    continue;
+                emit(mv[i]);
+                mv.erase(mv.begin() + i);
+                progress = true;
+                break;
+            }
+            if (progress)
+                continue;
+
+            // A cycle; break it through the stack slot
+            move& m = mv[0];
+            out.push_back(new ir(I_SPILL_STORE, m.from, slot(m.vreg)));
+            m.from = new reg;
+            m.from->spilt = true;
+            m.from->dest = slot(m.vreg);
+        }
+    }
+
+    void rewrite() {
+        std::unordered_set<int> starts;
+        for (auto [from, to] : span)
+            starts.insert(from);
+
+        for (auto& ps : parts) {
+            std::sort(ps.begin(), ps.end(), [](interval* a, interval* b) {
+                return a->start() < b->start();
+            });
+            bool stack = false;
+            for (auto iv : ps)
+                stack |= iv->r->spilt;
+            if (!stack)
+                continue;
+
+            var* v = slot(ps[0]->vreg);
+            for (auto iv : ps)
+                iv->r->dest = v;
+        }
+
+        // Moves within blocks, where a register changes location
+        for (auto& ps : parts)
+            for (int i = 1; i < ps.size(); i++) {
+                interval* a = ps[i - 1];
+                interval* b = ps[i];
+                int at = b->start();
+                if (b->r->spilt || at % 2 || starts.count(at) || !a->covers(at - 1))
+                    continue;
+                if (a->r->spilt || a->r->real != b->r->real)
+                    moves[at].push_back({ a->vreg, a->r, b->r });
+            }
+
+        for (int i = 0; i < bs.size(); i++) {
+            std::vector<ir*> out;
+            int p = span[i].first;
+            for (auto x : bs[i]->irs) {
+                if (moves.count(p))
+                    sequence(out, moves[p]);
+
+                for (auto r : uses(x)) {
+                    reg* c = part(r, p)->r;
+                    if (c->spilt && x->ty != I_CALL)
+                        throw std::runtime_error("register spilt at use");
+                    replace_use(x, r, c);
+                }
+                out.push_back(x);
+
+                // The stack slot always holds the latest value
+                if (reg* d = def(x)) {
+                    reg* c = part(d, p + 1)->r;
+                    x->a0 = c;
+                    if (d->dest)
+                        out.push_back(new ir(I_SPILL_STORE, c, d->dest));
+                }
+                p += 2;
+            }
+            bs[i]->irs = out;
+        }
+    }
+
+    // Moves on edges, where a register is in different locations at both ends.
+    void resolve() {
+        std::vector<block*> added;
+        for (int i = 0; i < bs.size(); i++) {
+            block* p = bs[i];
+            for (auto s : p->succs) {
+                std::vector<move> mv;
+                for (auto k : live_in[bid[s]].members()) {
+                    reg* a = part(vregs[k], span[i].second - 1)->r;
+                    reg* b = part(vregs[k], span[bid[s]].first)->r;
+                    if (!b->spilt && (a->spilt || a->real != b->real))
+                        mv.push_back({ vregs[k], a, b });
+                }
+                if (mv.empty())
+                    continue;
+
+                std::vector<ir*> out;
+                sequence(out, mv);
+                ir* t = p->terminator();
+                if (t->ty == I_JMP)
+                    p->irs.insert(p->irs.end() - 1, out.begin(), out.end());
+                else if (s->preds.size() == 1)
+                    s->irs.insert(s->irs.begin(), out.begin(), out.end());
+                else {
+                    // Critical edge; the moves get a block of their own
+                    block* nb = new block;
+                    nb->irs = out;
+                    nb->irs.push_back(new ir(I_JMP, nullptr, s));
+                    if (t->to == s)
+                        t->to = nb;
+                    if (t->els == s)
+                        t->els = nb;
+                    for (auto& b : t->table)
+                        if (b == s)
+                            b = nb;
+                    added.push_back(nb);
+                }
+            }
+        }
+        bs.insert(bs.end(), added.begin(), added.end());
+        link(bs);
+    }
+
+    int run() {
+        solve();
+        build();
+        build_fixed();
+        scan();
+        rewrite();
+        resolve();
+
+        int used = 0;
+        for (auto& ps : parts)
+            for (auto iv : ps)
+                if (!iv->r->spilt)
+                    used |= 1 << iv->r->real;
+        return used;
+    }
+};
+
+// Weight of the code in each block: 10 to the depth of loops it is in.
+std::vector<double> loop_weights(cfg& bs) {
+    dominators(bs);
+    auto dominates = [](block* a, block* b) {
+        for (;; b = b->idom) {
+            if (a == b)
+                return true;
+            if (b == b->idom)
+                return false;
+        }
+    };
+
+    std::unordered_map<block*, int> depth;
+    for (auto p : bs)
+        for (auto h : p->succs) {
+            if (!dominates(h, p))
+                continue;
+            // Natural loop of the back edge p -> h
+            std::unordered_set<block*> body { h };
+            std::vector<block*> work { p };
+            while (!work.empty()) {
+                block* b = work.back();
+                work.pop_back();
+                if (body.insert(b).second)
+                    for (auto q : b->preds)
+                        work.push_back(q);
+            }
+            for (auto b : body)
+                depth[b]++;
+        }
+
+    std::vector<double> w;
+    for (auto b : bs)
+        w.push_back(std::pow(10, std::min(depth[b], 8)));
+    return w;
+}
+
+// Iterated register coalescing, after George and Appel.
+// One round colours the interference graph, or picks registers to spill.
+struct graph_coloring : liveness {
+    enum { INITIAL, SIMPLIFY, FREEZE, SPILL, SPILLED, COALESCED, COLORED, SELECT };
+    enum { M_WORKLIST, M_ACTIVE, M_COALESCED, M_CONSTRAINED, M_FROZEN };
+
+    // Reloads and stores made for spilling; spilling them again gains nothing
+    std::unordered_set<reg*>& temps;
+
+    // Interference graph, as matrix and lists
+    std::vector<bits> adj;
+    std::vector<std::vector<int>> adj_list;
+    std::vector<int> degree;
+
+    std::vector<int> state, alias, color;
+    std::vector<double> cost;
+    // Whether each node holds a value across a call
+    std::vector<bool> crosses;
+    // Real registers each node can't take, for their fixed uses.
+    // Each counts towards the degree, like a neighbour that never goes away.
+    std::vector<int> forbidden;
+
+    // Moves, as (destination, source)
+    std::vector<std::pair<int, int>> mv;
+    std::vector<int> mstate;
+    std::vector<std::vector<int>> move_list;
+
+    std::set<int> simplify_wl, freeze_wl, spill_wl;
+    // Might contain moves no longer in the worklist
+    std::vector<int> worklist_moves;
+    std::vector<int> select;
+    std::vector<reg*> spilled;
+
+    graph_coloring(func* f, cfg& bs, std::unordered_set<reg*>& temps): liveness(f, bs), temps(temps) {}
+
+    void add_edge(int u, int v) {
+        if (u == v || adj[u].test(v))
+            return;
+        adj[u].set(v);
+        adj[v].set(u);
+        adj_list[u].push_back(v);
+        adj_list[v].push_back(u);
+        degree[u]++;
+        degree[v]++;
+    }
+
+    void build() {
+        solve();
+        int n = vregs.size();
+        adj.assign(n, bits(n));
+        adj_list.resize(n);
+        degree.resize(n);
+        state.resize(n);
+        color.resize(n);
+        cost.resize(n);
+        forbidden.resize(n);
+        crosses.resize(n);
+        move_list.resize(n);
+        for (int i = 0; i < n; i++)
+            alias.push_back(i);
+
+        auto w = loop_weights(bs);
+        for (int i = 0; i < bs.size(); i++) {
+            bits live = live_out(i);
+            auto& irs = bs[i]->irs;
+            for (int j = irs.size() - 1; j >= 0; j--) {
+                ir* x = irs[j];
+                reg* d = def(x);
+
+                // Both ends of a move may share a register
+                if (x->ty == I_MOV) {
+                    int a = id(d), b = id(x->a1);
+                    live.reset(b);
+                    move_list[a].push_back(mv.size());
+                    move_list[b].push_back(mv.size());
+                    worklist_moves.push_back(mv.size());
+                    mv.push_back({ a, b });
+                    mstate.push_back(M_WORKLIST);
+                }
+
+                // idiv and one-operand imul take rax and rdx
+                if (x->ty == I_IDIV || x->ty == I_MOD || x->ty == I_MULHI) {
+                    int mask = 1 << reg_index("rax") | 1 << reg_index("rdx");
+                    for (auto l : live.members())
+                        if (vregs[l] != d)
+                            forbidden[l] |= mask;
+                    if (x->a2)
+                        forbidden[id(x->a2)] |= mask;
+                }
+
+                if (x->ty == I_CALL)
+                    for (auto l : live.members())
+                        if (vregs[l] != d)
+                            crosses[l] = true;
+
+                if (d) {
+                    for (auto l : live.members())
+                        add_edge(l, id(d));
+                    live.reset(id(d));
+                    cost[id(d)] += w[i];
+                }
+                for (auto r : reads(x)) {
+                    live.set(id(r));
+                    cost[id(r)] += w[i];
+                }
+            }
+        }
+
+        // Arguments stay in their registers until read
+        int pending = 0;
+        for (auto x : bs[0]->irs)
+            if (x->ty == I_ARG)
+                pending |= 1 << reg_index(arg_regs[x->imm]);
+        for (auto x : bs[0]->irs) {
+            if (x->ty == I_ARG)
+                pending &= ~(1 << reg_index(arg_regs[x->imm]));
+            if (reg* d = def(x))
+                forbidden[id(d)] |= pending;
+        }
+
+        for (int i = 0; i < n; i++)
+            degree[i] += __builtin_popcount(forbidden[i]);
+    }
+
+    std::vector<int> adjacent(int n) {
+        std::vector<int> res;
+        for (auto m : adj_list[n])
+            if (state[m] != SELECT && state[m] != COALESCED)
+                res.push_back(m);
+        return res;
+    }
+
+    std::vector<int> node_moves(int n) {
+        std::vector<int> res;
+        for (auto m : move_list[n])
+            if (mstate[m] == M_ACTIVE || mstate[m] == M_WORKLIST)
+                res.push_back(m);
+        return res;
+    }
+
+    bool move_related(int n) {
+        return !node_moves(n).empty();
+    }
+
+    void to(int n, int st) {
+        if (state[n] == SIMPLIFY)
+            simplify_wl.erase(n);
+        if (state[n] == FREEZE)
+            freeze_wl.erase(n);
+        if (state[n] == SPILL)
+            spill_wl.erase(n);
+
+        state[n] = st;
+        if (st == SIMPLIFY)
+            simplify_wl.insert(n);
+        if (st == FREEZE)
+            freeze_wl.insert(n);
+        if (st == SPILL)
+            spill_wl.insert(n);
+    }
+
+    void enable_moves(int n) {
+        for (auto m : node_moves(n))
+            if (mstate[m] == M_ACTIVE) {
+                mstate[m] = M_WORKLIST;
+                worklist_moves.push_back(m);
+            }
+    }
+
+    void decrement_degree(int m) {
+        if (degree[m]-- != rsz)
+            return;
+        enable_moves(m);
+        for (auto n : adjacent(m))
+            enable_moves(n);
+        to(m, move_related(m) ? FREEZE : SIMPLIFY);
+    }
+
+    void simplify() {
+        int n = *simplify_wl.begin();
+        to(n, SELECT);
+        select.push_back(n);
+        for (auto m : adjacent(n))
+            decrement_degree(m);
+    }
+
+    int get_alias(int n) {
+        while (state[n] == COALESCED)
+            n = alias[n];
+        return n;
+    }
+
+    void add_worklist(int u) {
+        if (state[u] == FREEZE && !move_related(u) && degree[u] < rsz)
+            to(u, SIMPLIFY);
+    }
+
+    // Briggs: the merged node has fewer than K neighbours of significant degree
+    // A neighbour of both is counted once, from u's side: adj[u] tells which
+    // of v's neighbours have been seen. Stops as soon as the answer is known.
+    bool conservative(int u, int v) {
+        int k = __builtin_popcount(forbidden[u] | forbidden[v]);
+        for (auto n : adj_list[u])
+            if (state[n] != SELECT && state[n] != COALESCED && degree[n] >= rsz && ++k >= rsz)
+                return false;
+        for (auto n : adj_list[v])
+            if (state[n] != SELECT && state[n] != COALESCED && degree[n] >= rsz && !adj[u].test(n) && ++k >= rsz)
+                return false;
+        return true;
+    }
+
+    void combine(int u, int v) {
+        to(v, COALESCED);
+        alias[v] = u;
+        int extra = forbidden[v] & ~forbidden[u];
+        forbidden[u] |= extra;
+        degree[u] += __builtin_popcount(extra);
+        crosses[u] = crosses[u] || crosses[v];
+        move_list[u].insert(move_list[u].end(), move_list[v].begin(), move_list[v].end());
+        enable_moves(v);
+        for (auto t : adjacent(v)) {
+            add_edge(t, u);
+            decrement_degree(t);
+        }
+        if (degree[u] >= rsz && state[u] == FREEZE)
+            to(u, SPILL);
+    }
+
+    void coalesce() {
+        int m = worklist_moves.back();
+        worklist_moves.pop_back();
+
+        int u = get_alias(mv[m].first);
+        int v = get_alias(mv[m].second);
+        if (u == v) {
+            mstate[m] = M_COALESCED;
+            add_worklist(u);
+        } else if (adj[u].test(v)) {
+            mstate[m] = M_CONSTRAINED;
+            add_worklist(u);
+            add_worklist(v);
+        } else if (conservative(u, v)) {
+            mstate[m] = M_COALESCED;
+            combine(u, v);
+            add_worklist(u);
+        } else
+            mstate[m] = M_ACTIVE;
+    }
+
+    void freeze_moves(int u) {
+        for (auto m : node_moves(u)) {
+            int x = get_alias(mv[m].first), y = get_alias(mv[m].second);
+            int v = y == get_alias(u) ? x : y;
+            mstate[m] = M_FROZEN;
+            if (state[v] == FREEZE && !move_related(v) && degree[v] < rsz)
+                to(v, SIMPLIFY);
+        }
+    }
+
+    void freeze() {
+        int u = *freeze_wl.begin();
+        to(u, SIMPLIFY);
+        freeze_moves(u);
+    }
+
+    // Cheapest to spill: least use, weighted by loops, per neighbour freed
+    void select_spill() {
+        int best = -1;
+        double best_cost = 0;
+        for (auto n : spill_wl) {
+            double c = cost[n] / degree[n];
+            if (temps.count(vregs[n]))
+                c = 1e300;
+            if (best < 0 || c < best_cost) {
+                best = n;
+                best_cost = c;
+            }
+        }
+        to(best, SIMPLIFY);
+        freeze_moves(best);
+    }
+
+    void assign_colors() {
+        while (!select.empty()) {
+            int n = select.back();
+            select.pop_back();
+
+            bool ok[rsz];
+            for (int c = 0; c < rsz; c++)
+                ok[c] = !(forbidden[n] >> c & 1);
+            for (auto w : adj_list[n]) {
+                int a = get_alias(w);
+                if (state[a] == COLORED)
+                    ok[color[a]] = false;
+            }
+
+            // A callee-saved register is saved once in the prologue, not around every call
+            int c = rsz;
+            if (crosses[n])
+                c = std::find(ok + callee_saved, ok + rsz, true) - ok;
+            if (c == rsz)
+                c = std::find(ok, ok + rsz, true) - ok;
+            if (c == rsz) {
+                state[n] = SPILLED;
+                spilled.push_back(vregs[n]);
+            } else {
+                state[n] = COLORED;
+                color[n] = c;
+            }
+        }
+    }
+
+    // Spilt registers are reloaded before each use and stored after each definition.
+    // Call arguments are read from the stack slot directly.
+    void rewrite() {
+        for (auto r : spilled) {
+            slot(r);
+            r->spilt = true;
+        }
+
+        for (auto b : bs) {
+            std::vector<ir*> out;
+            for (auto x : b->irs) {
+                if (x->ty != I_CALL)
+                    for (auto r : uses(x)) {
+                        if (!r->spilt)
+                            continue;
+                        reg* t = new reg;
+                        temps.insert(t);
+                        out.push_back(new ir(I_SPILL_LOAD, t, r->dest));
+                        replace_use(x, r, t);
+                    }
+                out.push_back(x);
+
+                reg* d = def(x);
+                if (d && d->spilt) {
+                    reg* t = new reg;
+                    temps.insert(t);
+                    x->a0 = t;
+                    out.push_back(new ir(I_SPILL_STORE, t, d->dest));
+                }
+            }
+            b->irs = out;
+        }
+    }
+
+    // Returns whether every register got a colour.
+    bool run() {
+        build();
+        for (int i = 0; i < vregs.size(); i++)
+            to(i, degree[i] >= rsz ? SPILL : move_related(i) ? FREEZE : SIMPLIFY);
+
+        for (;;) {
+            while (!worklist_moves.empty() && mstate[worklist_moves.back()] != M_WORKLIST)
+                worklist_moves.pop_back();
+
+            if (!simplify_wl.empty())
+                simplify();
+            else if (!worklist_moves.empty())
+                coalesce();
+            else if (!freeze_wl.empty())
+                freeze();
+            else if (!spill_wl.empty())
+                select_spill();
+            else
+                break;
+        }
+        assign_colors();
+
+        if (!spilled.empty()) {
+            rewrite();
+            return false;
+        }
+
+        for (int i = 0; i < vregs.size(); i++)
+            vregs[i]->real = color[get_alias(i)];
+        return true;
+    }
+};
+
+// Fills ir::saved of calls with the caller-saved registers read after them.
+void find_saved(cfg& bs) {
+    auto reads = [](ir* x) {
+        int mask = 0;
+        for (auto r : uses(x))
+            if (!r->spilt)
+                mask |= 1 << r->real;
+        return mask;
+    };
+
+    std::unordered_map<block*, int> live_in;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (int i = bs.size() - 1; i >= 0; i--) {
+            int live = 0;
+            for (auto s : bs[i]->succs)
+                live |= live_in[s];
+
+            auto& irs = bs[i]->irs;
+            for (int j = irs.size() - 1; j >= 0; j--) {
+                ir* x = irs[j];
+                reg* d = def(x);
+                if (d)
+                    live &= ~(1 << d->real);
+                if (x->ty == I_CALL)
+                    x->saved = live & ((1 << callee_saved) - 1);
+                live |= reads(x);
+            }
+
+            if (live != live_in[bs[i]]) {
+                live_in[bs[i]] = live;
+                changed = true;
+            }
+        }
+    }
+}
+
+int allocate(func* f, cfg& bs) {
+    if (!coloring) {
+        int used = linear_scan(f, bs).run();
+        find_saved(bs);
+        return used;
+    }
+
+    std::unordered_set<reg*> temps;
+    while (!graph_coloring(f, bs, temps).run());
+    find_saved(bs);
+
+    int used = 0;
+    for (auto b : bs)
+        for (auto x : b->irs) {
+            for (auto r : uses(x))
+                if (!r->spilt)
+                    used |= 1 << r->real;
+            if (reg* d = def(x))
+                used |= 1 << d->real;
+        }
+    return used;
+}
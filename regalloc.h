@@ -0,0 +1,21 @@
+#pragma once
+#include "ir.h"
+
+// Registers that can be allocated; reg::real indexes into it.
+// Caller-saved ones come first, and callee-saved ones from callee_saved on.
+extern const char* regs[];
+extern const int rsz;
+extern const int callee_saved;
+
+// Index of the register in regs[].
+int reg_index(std::string_view name);
+
+// Whether to allocate by graph colouring (-O2), which is slower
+// than the default linear scan but spills less and removes copies.
+extern bool coloring;
+
+// Gives every register of the function a real register.
+// Values that don't fit live in stack slots appended to f->frame,
+// and the code is rewritten with the reloads and moves they need.
+// Returns the set of real registers used, as a bit mask.
+int allocate(func* f, cfg& bs);
@@ -0,0 +1,391 @@
+#include "ssa.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+void prune(cfg& bs) {
+    link(bs);
+
+    std::unordered_set<block*> seen { bs[0] };
+    std::vector<block*> stack { bs[0] };
+    while (!stack.empty()) {
+        block* b = stack.back();
+        stack.pop_back();
+        for (auto s : b->succs)
+            if (seen.insert(s).second)
+                stack.push_back(s);
+    }
+
+    bs.erase(std::remove_if(bs.begin(), bs.end(), [&](block* b) { return !seen.count(b); }), bs.end());
+
+    // Phis forget about the predecessors removed
+    for (auto b : bs)
+        for (auto x : b->irs) {
+            if (x->ty != I_PHI)
+                break;
+            for (int i = x->from.size() - 1; i >= 0; i--)
+                if (!seen.count(x->from[i])) {
+                    x->from.erase(x->from.begin() + i);
+                    x->params.erase(x->params.begin() + i);
+                }
+        }
+
+    link(bs);
+}
+
+void postorder(block* b, std::unordered_map<block*, int>& po, std::vector<block*>& order) {
+    po[b] = -1;
+    for (auto s : b->succs)
+        if (!po.count(s))
+            postorder(s, po, order);
+    po[b] = order.size();
+    order.push_back(b);
+}
+
+// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm".
+void dominators(cfg& bs) {
+    std::unordered_map<block*, int> po;
+    std::vector<block*> order;
+    postorder(bs[0], po, order);
+
+    for (auto b : bs) {
+        b->idom = nullptr;
+        b->doms.clear();
+        b->frontier.clear();
+    }
+    block* entry = bs[0];
+    entry->idom = entry;
+
+    auto intersect = [&](block* a, block* b) {
+        while (a != b) {
+            while (po[a] < po[b])
+                a = a->idom;
+            while (po[b] < po[a])
+                b = b->idom;
+        }
+        return a;
+    };
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        // Reverse postorder, except the entry
+        for (int i = (int) order.size() - 2; i >= 0; i--) {
+            block* b = order[i];
+            block* idom = nullptr;
+            for (auto p : b->preds)
+                if (p->idom)
+                    idom = idom ? intersect(p, idom) : p;
+            if (idom != b->idom) {
+                b->idom = idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (auto b : bs)
+        if (b != entry)
+            b->idom->doms.push_back(b);
+
+    for (auto b : bs) {
+        if (b->preds.size() < 2)
+            continue;
+        for (auto p : b->preds)
+            for (block* r = p; r != b->idom; r = r->idom)
+                if (r->frontier.empty() || r->frontier.back() != b)
+                    r->frontier.push_back(b);
+    }
+}
+
+// Whether the value defined by d is unchanged by sign-extending its lowest sz bytes.
+bool fits(ir* d, int sz) {
+    if (!d)
+        return false;
+
+    long bound = 1L << (sz * 8 - 1);
+    switch (d->ty) {
+    case I_IMM:
+        return sz == 8 || d->imm >= -bound && d->imm < bound;
+    case I_LOAD:
+    case I_SEXT:
+        return d->sz <= sz;
+    case I_LE:
+    case I_GE:
+    case I_LEQ:
+    case I_GEQ:
+    case I_EQ:
+    case I_NEQ:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// One round of promotion; see mem2reg().
+struct promoter {
+    func* f;
+    cfg& bs;
+
+    // Where each register is defined
+    std::unordered_map<reg*, ir*> defs;
+    // Registers holding the address of a local, from I_LOCALREF
+    std::unordered_map<reg*, var*> addr;
+    // Index of each variable being promoted
+    std::unordered_map<var*, int> id;
+    std::vector<var*> vars;
+
+    // Current value of each variable during renaming
+    std::vector<std::vector<reg*>> stack;
+    // Value of variables read before written
+    std::vector<reg*> undef;
+    // Loads replaced by the value they would read
+    std::unordered_map<reg*, reg*> alias;
+
+    promoter(func* f, cfg& bs): f(f), bs(bs) {}
+
+    reg* resolve(reg* r) {
+        for (auto it = alias.find(r); it != alias.end(); it = alias.find(r))
+            r = it->second;
+        return r;
+    }
+
+    // Variable whose address r holds, if it is being promoted.
+    int promoted(reg* r) {
+        auto it = addr.find(r);
+        if (it == addr.end() || !id.count(it->second))
+            return -1;
+        return id[it->second];
+    }
+
+    reg* current(int k) {
+        if (!stack[k].empty())
+            return stack[k].back();
+        if (!undef[k])
+            undef[k] = new reg;
+        return undef[k];
+    }
+
+    void rename(block* b) {
+        std::vector<int> pushed;
+        std::vector<ir*> out;
+
+        for (auto x : b->irs) {
+            if (x->ty == I_PHI) {
+                if (id.count(x->v)) {
+                    stack[id[x->v]].push_back(x->a0);
+                    pushed.push_back(id[x->v]);
+                }
+                out.push_back(x);
+                continue;
+            }
+
+            for (auto r : uses(x))
+                replace_use(x, r, resolve(r));
+
+            if (x->ty == I_LOCALREF && id.count(x->v))
+                continue;
+
+            if (x->ty == I_LOAD && promoted(x->a1) >= 0) {
+                alias[x->a0] = current(promoted(x->a1));
+                continue;
+            }
+
+            if (x->ty == I_STORE && promoted(x->a0) >= 0) {
+                int k = promoted(x->a0);
+                reg* val = x->a1;
+                // Memory would have truncated the value
+                if (x->sz < 8 && !fits(defs[val], x->sz)) {
+                    reg* t = new reg;
+                    ir* ext = new ir(I_SEXT, t, val, x->sz);
+                    defs[t] = ext;
+                    out.push_back(ext);
+                    val = t;
+                }
+                stack[k].push_back(val);
+                pushed.push_back(k);
+                continue;
+            }
+
+            out.push_back(x);
+        }
+        b->irs = out;
+
+        for (auto s : b->succs)
+            for (auto x : s->irs) {
+                if (x->ty != I_PHI)
+                    break;
+                if (!id.count(x->v))
+                    continue;
+                x->params.push_back(current(id[x->v]));
+                x->from.push_back(b);
+            }
+
+        for (auto c : b->doms)
+            rename(c);
+
+        for (auto k : pushed)
+            stack[k].pop_back();
+    }
+
+    bool run() {
+        std::unordered_set<var*> bad;
+
+        // Arguments passed on stack are never stored to
+        for (int i = 6; i < f->params.size(); i++)
+            bad.insert(f->params[i]);
+
+        for (auto b : bs)
+            for (auto x : b->irs) {
+                if (reg* d = def(x))
+                    defs[d] = x;
+                if (x->ty != I_LOCALREF)
+                    continue;
+
+                var* v = x->v;
+                if (v->ty->ty == K_LBRACKET)
+                    bad.insert(v);
+                if (!id.count(v)) {
+                    id[v] = vars.size();
+                    vars.push_back(v);
+                }
+                addr[x->a0] = v;
+            }
+
+        // Every use of the address must be a load or store of the whole variable
+        for (auto b : bs)
+            for (auto x : b->irs)
+                for (auto r : uses(x)) {
+                    auto it = addr.find(r);
+                    if (it == addr.end())
+                        continue;
+
+                    var* v = it->second;
+                    bool ok = x->ty == I_LOAD && x->a1 == r && x->sz == v->ty->sz ||
+                        x->ty == I_STORE && x->a0 == r && x->a1 != r && x->sz == v->ty->sz;
+                    if (!ok)
+                        bad.insert(v);
+                }
+
+        vars.erase(std::remove_if(vars.begin(), vars.end(), [&](var* v) { return bad.count(v); }), vars.end());
+        if (vars.empty())
+            return false;
+
+        id.clear();
+        for (int i = 0; i < vars.size(); i++)
+            id[vars[i]] = i;
+        stack.resize(vars.size());
+        undef.resize(vars.size());
+
+        place_phis();
+        rename(bs[0]);
+
+        // Old phis may read values of loads just removed
+        for (auto b : bs)
+            for (auto x : b->irs)
+                for (auto r : uses(x))
+                    replace_use(x, r, resolve(r));
+
+        std::vector<ir*> init;
+        for (auto r : undef)
+            if (r)
+                init.push_back(new ir(I_IMM, 0, r));
+        bs[0]->irs.insert(bs[0]->irs.begin(), init.begin(), init.end());
+
+        auto& fr = f->frame;
+        fr.erase(std::remove_if(fr.begin(), fr.end(), [&](var* v) { return id.count(v); }), fr.end());
+        return true;
+    }
+
+    void place_phis() {
+        std::vector<std::vector<block*>> stores(vars.size());
+        for (auto b : bs)
+            for (auto x : b->irs)
+                if (x->ty == I_STORE && promoted(x->a0) >= 0)
+                    stores[promoted(x->a0)].push_back(b);
+
+        for (int k = 0; k < vars.size(); k++) {
+            std::vector<block*> work = stores[k];
+            std::unordered_set<block*> queued(work.begin(), work.end());
+            std::unordered_set<block*> has_phi;
+
+            while (!work.empty()) {
+                block* b = work.back();
+                work.pop_back();
+                for (auto d : b->frontier) {
+                    if (!has_phi.insert(d).second)
+                        continue;
+
+                    ir* phi = new ir(I_PHI, new reg);
+                    phi->v = vars[k];
+                    d->irs.insert(d->irs.begin(), phi);
+                    if (queued.insert(d).second)
+                        work.push_back(d);
+                }
+            }
+        }
+    }
+};
+
+// Removes phis whose values are never used.
+void remove_dead_phis(cfg& bs) {
+    std::unordered_set<reg*> live;
+    std::vector<ir*> phis;
+    for (auto b : bs)
+        for (auto x : b->irs) {
+            if (x->ty == I_PHI) {
+                phis.push_back(x);
+                continue;
+            }
+            for (auto r : uses(x))
+                live.insert(r);
+        }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto x : phis)
+            if (live.count(x->a0))
+                for (auto r : x->params)
+                    changed |= live.insert(r).second;
+    }
+
+    for (auto b : bs) {
+        auto& v = b->irs;
+        v.erase(std::remove_if(v.begin(), v.end(), [&](ir* x) {
+            return x->ty == I_PHI && !live.count(x->a0);
+        }), v.end());
+    }
+}
+
+void mem2reg(func* f, cfg& bs) {
+    prune(bs);
+    dominators(bs);
+
+    // Promoting a pointer may leave the address it held used only by
+    // loads and stores (eg. the temporary of +=), so repeat until nothing changes.
+    // Dead phis of the pointer would still use the address.
+    while (promoter(f, bs).run())
+        remove_dead_phis(bs);
+}
+
+void leave_ssa(cfg& bs) {
+    // A phi becomes a copy into a fresh register at the end of each
+    // predecessor, and a copy from that register where the phi was.
+    // The fresh register keeps copies of different phis from interfering.
+    std::vector<std::pair<block*, ir*>> copies;
+    for (auto b : bs) {
+        std::vector<ir*> out;
+        for (auto x : b->irs) {
+            if (x->ty != I_PHI) {
+                out.push_back(x);
+                continue;
+            }
+            reg* t = new reg;
+            for (int i = 0; i < x->params.size(); i++)
+                copies.emplace_back(x->from[i], new ir(I_MOV, t, x->params[i]));
+            out.push_back(new ir(I_MOV, x->a0, t));
+        }
+        b->irs = out;
+    }
+
+    for (auto [b, x] : copies)
+        b->irs.insert(b->irs.end() - 1, x);
+}
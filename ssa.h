@@ -0,0 +1,16 @@
+#pragma once
+#include "ir.h"
+
+// Removes blocks that can't be reached from the entry.
+void prune(cfg&);
+
+// Computes the dominator tree and dominance frontiers.
+// All blocks must be reachable.
+void dominators(cfg&);
+
+// Promotes scalar locals whose address is never taken into registers,
+// putting the function into SSA form.
+void mem2reg(func*, cfg&);
+
+// Replaces phis by copies, so that the IR can be assembled.
+void leave_ssa(cfg&);
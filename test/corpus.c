@@ -0,0 +1,169 @@
+// Generator of large programs, for measuring compile time.
+// Prints a random but valid program of n functions to stdout; the program
+// prints a checksum when run, which gcc and this compiler must agree on.
+// Usage: corpus [n [seed]]
+int printf(char*, ...);
+int atoi(char*);
+
+long seed;
+// Whether the statement being printed is inside a loop over i.
+int inloop;
+
+// Returns a pseudo-random number in [0, n).
+long rnd(long n) {
+    seed = (seed * 1103515245 + 12345) % 2147483648;
+    return seed / 65536 % n;
+}
+
+// Prints the name of function k. Identifiers cannot contain digits,
+// so k is spelled in base 26.
+void name(int k) {
+    printf("fn");
+    while (k > 0) {
+        printf("%c", 'a' + k % 26);
+        k = k / 26;
+    }
+}
+
+void operand() {
+    int r = rnd(5);
+    if (r == 0)
+        printf("x");
+    if (r == 1)
+        printf("y");
+    if (r == 2)
+        printf("z");
+    if (r == 3)
+        printf("%ld", rnd(1000));
+    if (r == 4) {
+        if (inloop)
+            printf("i");
+        else
+            printf("t[%ld]", rnd(8));
+    }
+}
+
+void expr() {
+    operand();
+    int r = rnd(5);
+    if (r == 0)
+        printf(" + ");
+    if (r == 1)
+        printf(" - ");
+    if (r == 2)
+        printf(" * ");
+    if (r == 3) {
+        printf(" / %ld", rnd(100) + 1);
+        return;
+    }
+    if (r == 4) {
+        printf(" %% %ld", rnd(100) + 1);
+        return;
+    }
+    operand();
+}
+
+void indent(int depth) {
+    for (int i = 0; i <= depth; i++)
+        printf("    ");
+}
+
+// Every assignment is reduced modulo a prime, so no product can overflow.
+void assign(int depth) {
+    indent(depth);
+    int r = rnd(4);
+    if (r == 0)
+        printf("x");
+    if (r == 1)
+        printf("y");
+    if (r == 2)
+        printf("z");
+    if (r == 3) {
+        if (inloop)
+            printf("t[i % 8]");
+        else
+            printf("t[%ld]", rnd(8));
+    }
+    printf(" = (");
+    expr();
+    printf(") %% 1000003;\n");
+}
+
+void stmt(int depth) {
+    int r = rnd(6);
+    if (r == 4 && depth < 2) {
+        indent(depth);
+        printf("if (");
+        operand();
+        printf(" < ");
+        operand();
+        printf(") {\n");
+        assign(depth + 1);
+        indent(depth);
+        printf("} else {\n");
+        assign(depth + 1);
+        indent(depth);
+        printf("}\n");
+        return;
+    }
+    if (r == 5 && depth == 0) {
+        indent(depth);
+        printf("for (int i = 0; i < %ld; i++) {\n", rnd(16) + 1);
+        int m = rnd(4) + 1;
+        inloop = 1;
+        for (int k = 0; k < m; k++)
+            stmt(depth + 1);
+        inloop = 0;
+        indent(depth);
+        printf("}\n");
+        return;
+    }
+    assign(depth);
+}
+
+void function(int k) {
+    printf("long ");
+    name(k);
+    printf("(long a, long b) {\n");
+    printf("    long x = a %% 1000003;\n");
+    printf("    long y = b %% 1000003;\n");
+    printf("    long z = %ld;\n", rnd(1000));
+    printf("    long t[8];\n");
+    printf("    for (int i = 0; i < 8; i++)\n");
+    printf("        t[i] = i * x + y;\n");
+    int m = rnd(20) + 5;
+    for (int i = 0; i < m; i++)
+        stmt(0);
+    // Call at most one earlier function, so the run time stays linear.
+    if (k > 0) {
+        printf("    z = (z + ");
+        name(rnd(k));
+        printf("(x, y)) %% 1000003;\n");
+    }
+    printf("    return x + y + z + t[%ld];\n", rnd(8));
+    printf("}\n\n");
+}
+
+int main(int argc, char** argv) {
+    int n = 1000;
+    seed = 1;
+    if (argc > 1)
+        n = atoi(argv[1]);
+    if (argc > 2)
+        seed = atoi(argv[2]);
+
+    printf("int printf(char*, ...);\n\n");
+    for (int k = 0; k < n; k++)
+        function(k);
+
+    printf("int main() {\n");
+    printf("    long sum = 0;\n");
+    printf("    for (int i = 0; i < %d; i++)\n", n);
+    printf("        sum = (sum + i * ");
+    name(n - 1);
+    printf("(i, sum)) %% 1000003;\n");
+    printf("    printf(\"%%ld\\n\", sum);\n");
+    printf("    return 0;\n");
+    printf("}\n");
+    return 0;
+}
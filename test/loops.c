@@ -0,0 +1,71 @@
+// Benchmark of loops and conditions.
+// Prints a checksum, which must not change between versions of the compiler.
+int printf(char*, ...);
+
+// Number of primes below n, by trial division.
+int primes(int n) {
+    int count = 0;
+    for (int i = 2; i < n; i++) {
+        int prime = 1;
+        for (int d = 2; d * d <= i; d++)
+            if (i % d == 0)
+                prime = 0;
+        count += prime;
+    }
+    return count;
+}
+
+// Total steps for numbers below n to reach 1 in the Collatz sequence.
+long collatz(int n) {
+    long steps = 0;
+    for (int i = 1; i < n; i++) {
+        long x = i;
+        while (x != 1) {
+            if (x % 2 == 0)
+                x = x / 2;
+            else
+                x = 3 * x + 1;
+            steps++;
+        }
+    }
+    return steps;
+}
+
+// Sorts a pseudo-random array by insertion and sums it up by position.
+long sort(int n) {
+    int a[4096];
+    long seed = 12345;
+    for (int i = 0; i < n; i++) {
+        seed = (seed * 1103515245 + 12345) % 2147483648;
+        a[i] = seed % 100000;
+    }
+
+    for (int i = 1; i < n; i++) {
+        int key = a[i];
+        int j = i;
+        int moving = 1;
+        while (moving) {
+            if (j == 0)
+                moving = 0;
+            else if (a[j - 1] <= key)
+                moving = 0;
+            else {
+                a[j] = a[j - 1];
+                j--;
+            }
+        }
+        a[j] = key;
+    }
+
+    long sum = 0;
+    for (int i = 0; i < n; i++)
+        sum = (sum * 31 + a[i]) % 1000000007;
+    return sum;
+}
+
+int main() {
+    printf("%d\n", primes(60000));
+    printf("%ld\n", collatz(300000));
+    printf("%ld\n", sort(4096));
+    return 0;
+}
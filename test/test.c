@@ -29,12 +29,131 @@ int fact(int x) {
     return x * fact(x - 1);
 }
 
+// Number of days in the month, or 0 if there is no such month.
+int days(int month) {
+    int d = 0;
+    switch (month) {
+    case 2:
+        d = 28;
+        break;
+    case 4:
+    case 6:
+    case 9:
+    case 11:
+        d = 30;
+        break;
+    default:
+        if (month >= 1 && month <= 12)
+            d = 31;
+    }
+    return d;
+}
+
+// Dense cases far from zero, whose table can't be indexed by a 32-bit displacement.
+int high(int x) {
+    switch (x) {
+    case 2147483640: return 1;
+    case 2147483641: return 2;
+    case 2147483642: return 3;
+    case 2147483643: return 4;
+    case 2147483644: return 5;
+    }
+    return 0;
+}
+
+int low(int x) {
+    switch (x) {
+    case -268435447: return 1;
+    case -268435446: return 2;
+    case -268435445: return 3;
+    case -268435444: return 4;
+    default: return 0;
+    }
+}
+
+// Maps a few sparse values.
+int sparse(int x) {
+    switch (x) {
+    case -7: return 1;
+    case 10: return 2;
+    case 300: return 3;
+    case 4000: return 4;
+    case 50000: return 5;
+    }
+    return 0;
+}
+
 void swap(int* a, int* b) {
     int t = *a;
     *a = *b;
     *b = t;
 }
 
+// Whether q and r are not n / d and n % d:
+// q rounds towards zero, and r has the sign of n.
+int wrong(long n, long d, long q, long r) {
+    if (q * d + r != n || r * r >= d * d)
+        return 1;
+    if (r < 0 && n >= 0 || r > 0 && n < 0)
+        return 1;
+    return 0;
+}
+
+// Divisions of n by constants, which become multiplications and shifts.
+int longdivs(long n) {
+    int bad = 0;
+    bad += wrong(n, 3, n / 3, n % 3);
+    bad += wrong(n, 7, n / 7, n % 7);
+    bad += wrong(n, -7, n / -7, n % -7);
+    bad += wrong(n, 10, n / 10, n % 10);
+    bad += wrong(n, 641, n / 641, n % 641);
+    bad += wrong(n, 1000000007, n / 1000000007, n % 1000000007);
+    bad += wrong(n, -1000, n / -1000, n % -1000);
+    bad += wrong(n, 2, n / 2, n % 2);
+    bad += wrong(n, -2, n / -2, n % -2);
+    bad += wrong(n, 8, n / 8, n % 8);
+    bad += wrong(n, -8, n / -8, n % -8);
+    bad += wrong(n, 1024, n / 1024, n % 1024);
+    return bad;
+}
+
+int intdivs(int n) {
+    int bad = 0;
+    bad += wrong(n, 3, n / 3, n % 3);
+    bad += wrong(n, 7, n / 7, n % 7);
+    bad += wrong(n, -7, n / -7, n % -7);
+    bad += wrong(n, 100, n / 100, n % 100);
+    bad += wrong(n, 2, n / 2, n % 2);
+    bad += wrong(n, 16, n / 16, n % 16);
+    bad += wrong(n, -16, n / -16, n % -16);
+    return bad;
+}
+
+int quarter(int n) {
+    return n / 4;
+}
+
+int rest(int n) {
+    return n % -4;
+}
+
+// Times once() is called.
+int evaluated;
+
+int once(int x) {
+    evaluated++;
+    return x;
+}
+
+int early(int x) {
+    int unused[8];
+    for (int i = 0; i < 8; i++)
+        unused[i] = x;
+    return x + 1;
+    printf("Unreachable\n");
+    return x;
+}
+
 int main() {
     // Calculation
     assert(1, 1);
@@ -45,6 +164,8 @@ int main() {
     assert(((((((((((((1)))))))))))), 1);
     assert(16 % (3 - 2), 0);
     assert(7 / 5 + 11 * 8 - 32 % 17, 74);
+    assert(-(3 * 4) / 5 % 2, 0);
+    assert(-7 % 4 + 7 / -2, -6);
 
     // Comparison
     assert(-1 < 0, 1);
@@ -53,6 +174,17 @@ int main() {
     assert(1 > -1, 1);
     assert(1 != 1, 0);
 
+    // Logical operators
+    assert(1 && 2, 1);
+    assert(1 && 0, 0);
+    assert(0 || 0, 0);
+    assert(0 || -3, 1);
+    assert(!0, 1);
+    assert(!5, 0);
+    assert(!!7, 1);
+    assert(1 < 2 && 3 < 4 || 0, 1);
+    assert(!(1 < 2) || 2 > 3, 0);
+
     // Variable operation
     int a = 0;
     assert(a, a);
@@ -62,6 +194,11 @@ int main() {
 
     a = a * 108;
     assert(a, 216);
+    assert(a * 1 + 0 - 0, 216);
+    assert(a * 8 / 1, 1728);
+    assert(a * 0 + a % 1, 0);
+    assert(a - a, 0);
+    assert(a == a, 1);
 
     --a;
     assert(a, 215);
@@ -76,6 +213,42 @@ int main() {
         b += a;
     assert(b, 23050);
 
+    // Break and continue
+    int found = -1;
+    for (int i = 0; i < 100; i++) {
+        if (i * i < 40)
+            continue;
+        found = i;
+        break;
+    }
+    assert(found, 7);
+
+    int odd = 0;
+    int k = 0;
+    while (1) {
+        k++;
+        if (k > 20)
+            break;
+        if (k % 2 == 0)
+            continue;
+        odd += k;
+    }
+    assert(odd, 100);
+
+    int pairs = 0;
+    for (int i = 0; i < 10; i++)
+        for (int j = 0; j < 10; j++) {
+            if (j > i)
+                break;
+            switch (j % 3) {
+            case 0:
+                continue;
+            default:
+                pairs++;
+            }
+        }
+    assert(pairs, 33);
+
     // Recursion
     assert(fact(10), 3628800);
 
@@ -108,6 +281,111 @@ int main() {
                 swap(arr + i, arr + j);
     for (int i = 0; i < 19; i++)
         assert(arr[i] <= arr[i + 1], 1);
+    short diffs[20];
+    char signs[20];
+    for (int i = 1; i < 19; i++) {
+        diffs[i] = arr[i - 1] % 1000 - arr[i + 1] % 1000;
+        signs[i] = 1;
+        if (diffs[i] < 0)
+            signs[i] = -1;
+    }
+    int negative = 0;
+    for (int i = 1; i < 19; i++)
+        negative += signs[i] * diffs[i] < 0;
+    assert(negative, 0);
+    long wide[4];
+    for (int i = 0; i < 4; i++)
+        wide[i] = i * 1000000;
+    long total = 0;
+    for (int i = 0; i < 4; i++)
+        if (wide[i] < wide[3 - i])
+            total = total + wide[i] - wide[3 - i] * 2;
+    assert(total, -9000000);
+    // Memory changed through a pointer or by a call is read again
+    int cells[4];
+    cells[0] = 5;
+    cells[1] = 7;
+    int before = cells[1];
+    int* alias = cells + 1;
+    *alias = 9;
+    assert(before + cells[1] + cells[1], 25);
+    swap(cells, alias);
+    assert(cells[0] * 10 + cells[1], 95);
+    cells[2] = cells[0] / 3 + cells[1] / 3 + cells[0] % 3;
+    assert(cells[2] + cells[0] / 3, 7);
+    assert(diffs[1] + diffs[2], arr[0] % 1000 + arr[1] % 1000 - arr[2] % 1000 - arr[3] % 1000);
+
+    assert(early(4), 5);
+
+    // Division by constants, with negative dividends and divisors
+    long big = 1048576;
+    big = big * big;
+    long dividends[16];
+    dividends[0] = -big - 3;
+    dividends[1] = -1000000008;
+    dividends[2] = -2147483647;
+    dividends[3] = -15;
+    dividends[4] = -8;
+    dividends[5] = -7;
+    dividends[6] = -1;
+    dividends[7] = 0;
+    dividends[8] = 1;
+    dividends[9] = 7;
+    dividends[10] = 15;
+    dividends[11] = 1000000008;
+    dividends[12] = big + 5;
+    dividends[13] = 2147483647;
+    dividends[14] = -1025;
+    dividends[15] = 1023;
+    int bad = 0;
+    for (int i = 0; i < 16; i++) {
+        bad += longdivs(dividends[i]);
+        if (dividends[i] >= -2147483647 && dividends[i] <= 2147483647)
+            bad += intdivs(dividends[i]);
+    }
+    assert(bad, 0);
+    assert(quarter(-15) * 10 + quarter(15), -27);
+    assert(rest(-15) * 10 + rest(15), -27);
+
+    // Compound assignment to elements, changed in place
+    char small[4];
+    for (int i = 0; i < 4; i++) {
+        small[i] = 100;
+        small[i] += 30 * i;
+        cells[i] = i;
+        cells[i] *= 5;
+        cells[i] -= 1;
+    }
+    assert(small[0] + small[1] + small[2] + small[3], 100 + 130 - 256 + 160 - 256 + 190 - 256);
+    assert(cells[0] + cells[3], 13);
+    cells[once(2)] += 4;
+    assert(evaluated, 1);
+    assert(cells[2], 13);
+
+    // Switch
+    int year = 0;
+    for (int i = 0; i <= 13; i++)
+        year += days(i);
+    assert(year, 365);
+    assert(sparse(-7) + sparse(10) + sparse(300) + sparse(4000) + sparse(50000), 15);
+    assert(sparse(11) + sparse(-6) + sparse(0), 0);
+    assert(high(2147483640) + high(2147483642) * 10 + high(2147483644) * 100, 531);
+    assert(high(2147483639) + high(2147483645) + high(0) + high(-2147483647), 0);
+    assert(low(-268435447) + low(-268435444) * 10, 41);
+    assert(low(-268435448) + low(-268435443) + low(268435447), 0);
+
+    // Short circuit
+    int c = 0;
+    if (c != 0 && 10 / c > 1)
+        c = 1;
+    assert(c, 0);
+    if (c == 0 || c++)
+        c += 2;
+    assert(c, 2);
+    int n = 0;
+    while (n < 100 && !(n * n > 50))
+        n++;
+    assert(n, 8);
 
     printf("Everything is good!\n");
     return 0;